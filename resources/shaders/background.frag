@@ -5,7 +5,6 @@ in INTERFACE {
 } In ;
 
 uniform float time;
-uniform float secondsPerMeasure;
 uniform vec2 inverseScreenSize;
 uniform bool useDigits = true;
 uniform bool useHLines = true;
@@ -28,6 +27,13 @@ vec2 flipUVIfNeeded(vec2 inUV){
 const float octaveLinesPositions[11] = float[](0.0/75.0, 7.0/75.0, 14.0/75.0, 21.0/75.0, 28.0/75.0, 35.0/75.0, 42.0/75.0, 49.0/75.0, 56.0/75.0, 63.0/75.0, 70.0/75.0);
 			
 uniform float mainSpeed;
+
+#define MAX_MEASURES 256
+// Start of each visible measure, relative to the current time.
+uniform float measureOffsets[MAX_MEASURES];
+uniform int firstMeasure;
+uniform int measuresCount;
+
 uniform float keyboardHeight = 0.25;
 
 uniform int minNoteMajor;
@@ -125,15 +131,10 @@ void main(){
 	}
 
 	// Text on the side.
-	int currentMesure = int(floor(time/secondsPerMeasure));
-	// How many mesures do we check.
-	int count = int(ceil(0.75*(2.0/mainSpeed)))+2;
-
-	// We check two extra measures to avoid sudden disappearance below the keyboard.
-	for(int i = -2; i < count; i++){
-		// Compute position of the measure currentMesure+-i.
-		int mesure = currentMesure + (reverseMode ? -1 : 1) * i;
-		vec2 position = vec2(0.005, keyboardHeight + (reverseMode ? -1.0 : 1.0) * (secondsPerMeasure * mesure - time)*mainSpeed*0.5);
+	// Visible measures are selected beforehand, following tempo changes.
+	for(int i = 0; i < measuresCount; i++){
+		int mesure = firstMeasure + i;
+		vec2 position = vec2(0.005, keyboardHeight + (reverseMode ? -1.0 : 1.0) * measureOffsets[i]*mainSpeed*0.5);
 
 		// Compute color for the number display, and for the horizontal line.
 		float numberIntensity = useDigits ? printNumber(mesure, position, inUV, scale) : 0.0;
@@ -1,16 +1,24 @@
 #version 330
+#define SETS_COUNT 12
 
 layout(location = 0) in vec2 v;
 layout(location = 1) in int onChan;
 
 uniform float time;
-uniform vec2 inverseScreenSize;
 uniform float userScale = 1.0;
-uniform float keyboardHeight = 0.25;
 
-uniform int minNote;
-uniform float notesCount;
-uniform bool horizontalMode = false;
+// Values shared by all scene programs, see MIDIScene::SceneData.
+layout(std140) uniform SceneData {
+	vec4 majorColors[SETS_COUNT];
+	vec4 minorColors[SETS_COUNT];
+	vec2 inverseScreenSize;
+	float keyboardHeight;
+	float minorsWidth;
+	float notesCount;
+	int minNote;
+	int minNoteMajor;
+	bool horizontalMode;
+};
 
 vec2 flipIfNeeded(vec2 inPos){
 	return horizontalMode ? vec2(inPos.y, -inPos.x) : inPos;
@@ -7,17 +7,24 @@ in INTERFACE {
 #define SETS_COUNT 12
 #define MAJOR_COUNT 75
 
-uniform vec2 inverseScreenSize;
-uniform float minorsWidth = 1.0;
 uniform vec3 keysColor = vec3(0.0);
 uniform vec3 minorColor[SETS_COUNT];
 uniform vec3 majorColor[SETS_COUNT];
 uniform bool highlightKeys;
-uniform bool horizontalMode = false;
 uniform int actives[128];
 
-uniform int minNoteMajor;
-uniform float notesCount; // (maxNoteMajor - minNoteMajor + 1)
+// Values shared by all scene programs, see MIDIScene::SceneData.
+layout(std140) uniform SceneData {
+	vec4 majorColors[SETS_COUNT];
+	vec4 minorColors[SETS_COUNT];
+	vec2 inverseScreenSize;
+	float keyboardHeight;
+	float minorsWidth;
+	float notesCount;
+	int minNote;
+	int minNoteMajor;
+	bool horizontalMode;
+};
 
 const bool isMinor[MAJOR_COUNT] = bool[](true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, true, true, false,  true, true, false, true, false);
 
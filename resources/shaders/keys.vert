@@ -1,4 +1,5 @@
 #version 330
+#define SETS_COUNT 12
 
 layout(location = 0) in vec2 v;
 
@@ -6,8 +7,18 @@ out INTERFACE {
 	vec2 uv;
 } Out ;
 
-uniform float keyboardHeight = 0.25;
-uniform bool horizontalMode = false;
+// Values shared by all scene programs, see MIDIScene::SceneData.
+layout(std140) uniform SceneData {
+	vec4 majorColors[SETS_COUNT];
+	vec4 minorColors[SETS_COUNT];
+	vec2 inverseScreenSize;
+	float keyboardHeight;
+	float minorsWidth;
+	float notesCount;
+	int minNote;
+	int minNoteMajor;
+	bool horizontalMode;
+};
 
 vec2 flipIfNeeded(vec2 inPos){
 	return horizontalMode ? vec2(inPos.y, -inPos.x) : inPos;
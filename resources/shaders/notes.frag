@@ -8,13 +8,21 @@ in INTERFACE {
 	float channel;
 } In;
 
-uniform vec3 baseColor[SETS_COUNT];
-uniform vec3 minorColor[SETS_COUNT];
-uniform vec2 inverseScreenSize;
 uniform float colorScale;
-uniform float keyboardHeight = 0.25;
 uniform float fadeOut = 0.0;
-uniform bool horizontalMode = false;
+
+// Values shared by all scene programs, see MIDIScene::SceneData.
+layout(std140) uniform SceneData {
+	vec4 majorColors[SETS_COUNT];
+	vec4 minorColors[SETS_COUNT];
+	vec2 inverseScreenSize;
+	float keyboardHeight;
+	float minorsWidth;
+	float notesCount;
+	int minNote;
+	int minNoteMajor;
+	bool horizontalMode;
+};
 
 #define cornerRadius 0.01
 
@@ -39,7 +47,7 @@ void main(){
 	
 	// Fragment color.
 	int cid = int(In.channel);
-	fragColor.rgb = colorScale * mix(baseColor[cid], minorColor[cid], In.isMinor);
+	fragColor.rgb = colorScale * mix(majorColors[cid].rgb, minorColors[cid].rgb, In.isMinor);
 	
 	if(	radiusPosition > 0.8){
 		fragColor.rgb *= 1.05;
@@ -1,4 +1,5 @@
 #version 330
+#define SETS_COUNT 12
 
 layout(location = 0) in vec2 v;
 layout(location = 1) in vec4 id; //note id, start, duration, is minor
@@ -6,18 +7,26 @@ layout(location = 2) in float channel; //note id, start, duration, is minor
 
 uniform float time;
 uniform float mainSpeed;
-uniform float minorsWidth = 1.0;
-uniform float keyboardHeight = 0.25;
 uniform bool reverseMode = false;
-uniform bool horizontalMode = false;
+uniform int setOverride = -1; // Set of all drawn notes, if not negative.
+
+// Values shared by all scene programs, see MIDIScene::SceneData.
+layout(std140) uniform SceneData {
+	vec4 majorColors[SETS_COUNT];
+	vec4 minorColors[SETS_COUNT];
+	vec2 inverseScreenSize;
+	float keyboardHeight;
+	float minorsWidth;
+	float notesCount;
+	int minNote;
+	int minNoteMajor;
+	bool horizontalMode;
+};
 
 vec2 flipIfNeeded(vec2 inPos){
 	return horizontalMode ? vec2(inPos.y, -inPos.x) : inPos;
 }
 
-uniform int minNoteMajor;
-uniform float notesCount;
-
 out INTERFACE {
 	vec2 uv;
 	vec2 noteSize;
@@ -51,7 +60,7 @@ void main(){
 	// Scale uv.
 	Out.uv = Out.noteSize * v;
 	Out.isMinor = id.w;
-	Out.channel = channel;
+	Out.channel = setOverride >= 0 ? float(setOverride) : channel;
 	// Output position.
 	gl_Position = vec4(flipIfNeeded(Out.noteSize * v + noteShift), 0.0 , 1.0) ;
 	
@@ -2,28 +2,34 @@
 #define SETS_COUNT 12
 
 layout(location = 0) in vec2 v;
+// Note, elapsed time, duration and set of the particles system.
+layout(location = 1) in vec4 system;
 
-uniform float time;
 uniform float scale;
 uniform vec3 baseColor[SETS_COUNT];
-uniform vec2 inverseScreenSize;
 uniform sampler2D textureParticles;
 uniform vec2 inverseTextureSize;
 
-uniform int globalId;
-uniform float duration;
-uniform int channel;
+uniform int systemSize;
 
 uniform int texCount;
 uniform float colorScale;
 
 uniform float expansionFactor = 1.0;
 uniform float speedScaling = 0.2;
-uniform float keyboardHeight = 0.25;
 
-uniform int minNote;
-uniform float notesCount;
-uniform bool horizontalMode = false;
+// Values shared by all scene programs, see MIDIScene::SceneData.
+layout(std140) uniform SceneData {
+	vec4 majorColors[SETS_COUNT];
+	vec4 minorColors[SETS_COUNT];
+	vec2 inverseScreenSize;
+	float keyboardHeight;
+	float minorsWidth;
+	float notesCount;
+	int minNote;
+	int minNoteMajor;
+	bool horizontalMode;
+};
 
 vec2 flipIfNeeded(vec2 inPos){
 	return horizontalMode ? vec2(inPos.y, -inPos.x) : inPos;
@@ -46,7 +52,14 @@ float rand(vec2 co){
 
 
 void main(){
-	Out.id = float(gl_InstanceID % texCount);
+	// Each system covers systemSize consecutive instances.
+	int localId = gl_InstanceID % systemSize;
+	int globalId = int(system.x);
+	float time = system.y;
+	float duration = system.z;
+	int channel = int(system.w);
+
+	Out.id = float(localId % texCount);
 	Out.uv = v + 0.5;
 	// Fade color based on time.
 	Out.color = vec4(colorScale * baseColor[channel], 1.0-time*time);
@@ -55,7 +68,7 @@ void main(){
 	float particlesCount = 1.0/inverseTextureSize.y;
 	
 	// Pick particle id at random.
-	float particleId = float(gl_InstanceID) + floor(particlesCount * 10.0 * rand(vec2(globalId,globalId)));
+	float particleId = float(localId) + floor(particlesCount * 10.0 * rand(vec2(globalId,globalId)));
 	float textureId = mod(particleId,particlesCount);
 	float particleShift = floor(particleId/particlesCount);
 	
@@ -0,0 +1,64 @@
+#version 330
+#define SETS_COUNT 12
+
+layout(location = 0) in vec2 v;
+// Per particle state, see particlesupdate.vert.
+layout(location = 1) in vec4 state;
+layout(location = 2) in vec4 infos;
+
+uniform float scale;
+uniform vec3 baseColor[SETS_COUNT];
+uniform int texCount;
+uniform float colorScale;
+
+// Values shared by all scene programs, see MIDIScene::SceneData.
+layout(std140) uniform SceneData {
+	vec4 majorColors[SETS_COUNT];
+	vec4 minorColors[SETS_COUNT];
+	vec2 inverseScreenSize;
+	float keyboardHeight;
+	float minorsWidth;
+	float notesCount;
+	int minNote;
+	int minNoteMajor;
+	bool horizontalMode;
+};
+
+vec2 flipIfNeeded(vec2 inPos){
+	return horizontalMode ? vec2(inPos.y, -inPos.x) : inPos;
+}
+
+const float shifts[128] = float[](
+0,0.5,1,1.5,2,3,3.5,4,4.5,5,5.5,6,7,7.5,8,8.5,9,10,10.5,11,11.5,12,12.5,13,14,14.5,15,15.5,16,17,17.5,18,18.5,19,19.5,20,21,21.5,22,22.5,23,24,24.5,25,25.5,26,26.5,27,28,28.5,29,29.5,30,31,31.5,32,32.5,33,33.5,34,35,35.5,36,36.5,37,38,38.5,39,39.5,40,40.5,41,42,42.5,43,43.5,44,45,45.5,46,46.5,47,47.5,48,49,49.5,50,50.5,51,52,52.5,53,53.5,54,54.5,55,56,56.5,57,57.5,58,59,59.5,60,60.5,61,61.5,62,63,63.5,64,64.5,65,66,66.5,67,67.5,68,68.5,69,70,70.5,71,71.5,72,73,73.5,74
+);
+
+out INTERFACE {
+	vec4 color;
+	vec2 uv;
+	float id;
+} Out;
+
+void main(){
+	int note = int(infos.x);
+	float age = infos.y;
+
+	Out.id = float(gl_InstanceID % texCount);
+	Out.uv = v + 0.5;
+	// Fade color based on age.
+	Out.color = vec4(colorScale * baseColor[int(infos.z)], 1.0 - age * age);
+
+	// Horizontal shift is based on the note ID.
+	float xshift = -1.0 + ((shifts[note] - shifts[int(minNote)]) * 2.0 + 1.0) / notesCount;
+	vec2 globalShift = vec2(xshift, (2.0 * keyboardHeight - 1.0)-0.02);
+	vec2 localShift = 0.003 * scale * v + state.xy;
+
+	float screenRatio = inverseScreenSize.y/inverseScreenSize.x;
+	vec2 screenScaling = vec2(1.0, horizontalMode ? (1.0/screenRatio) : screenRatio);
+
+	vec2 finalPos = globalShift + screenScaling * localShift;
+	// Dead and unused particles are put off-screen.
+	if(age < 0.0 || age >= 1.0){
+		finalPos = vec2(-200.0);
+	}
+	gl_Position = vec4(flipIfNeeded(finalPos), 0.0, 1.0);
+}
@@ -0,0 +1,49 @@
+#version 330
+
+// Local position and velocity of the particle.
+layout(location = 0) in vec4 state;
+// Note, age (negative for new particles), set and lifetime.
+layout(location = 1) in vec4 infos;
+
+uniform float deltaTime;
+uniform float expansionFactor = 1.0;
+uniform float speedScaling = 0.2;
+
+// Captured by transform feedback.
+out vec4 outState;
+out vec4 outInfos;
+
+float rand(vec2 co){
+	return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);
+}
+
+void main(){
+	outState = state;
+	outInfos = infos;
+	// Dead particles stay as they are.
+	if(infos.y >= 1.0){
+		return;
+	}
+	float seed = float(gl_VertexID);
+	vec2 position = state.xy;
+	vec2 velocity = state.zw;
+
+	// New particles are launched upwards in a random direction.
+	if(infos.y < 0.0){
+		float angle = 0.7 * (rand(vec2(seed, infos.x)) - 0.5);
+		float speed = mix(0.15, 0.5, rand(vec2(infos.x, seed + 0.5)));
+		velocity = speed * vec2(sin(angle) * expansionFactor, cos(angle));
+		position = vec2(0.0);
+		outInfos.y = 0.0;
+	}
+
+	float dt = 5.0 * speedScaling * deltaTime;
+	// Swirl sideways, rise slowly and slow down.
+	float phase = 6.2831 * (2.0 * outInfos.y + rand(vec2(seed, seed)));
+	vec2 acceleration = vec2(0.2 * expansionFactor * sin(phase), 0.05);
+	velocity = (velocity + dt * acceleration) * exp(-1.5 * dt);
+	position += dt * velocity;
+
+	outState = vec4(position, velocity);
+	outInfos.y += deltaTime / infos.w;
+}
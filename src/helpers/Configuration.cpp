@@ -2,6 +2,7 @@
 #include "../rendering/State.h"
 #include "../helpers/Recorder.h"
 #include "../helpers/System.h"
+#include "../midi/MIDIUtils.h"
 
 #include <iostream>
 #include <stdio.h>
@@ -28,7 +29,7 @@ std::string join(const std::vector<std::string>& strs, const std::string& delim)
 	return res;
 }
 
-Configuration::Configuration(const std::string& path, const std::vector<std::string>& argv){
+Configuration::Configuration(const std::string& path, const std::vector<std::string>& argv) : noteOverlap(NoteOverlap::RETRIGGER) {
 
 	// Attempt to load arguments from file.
 	Arguments argsFromFile;
@@ -83,6 +84,29 @@ Configuration::Configuration(const std::string& path, const std::vector<std::str
 			if(name == "gui-size" && vals.size() >= 1){
 				guiScale = Configuration::parseFloat(vals[0]);
 			}
+			if(name == "threads" && vals.size() >= 1){
+				threadsCount = (std::max)(0, Configuration::parseInt(vals[0]));
+			}
+			if(name == "cache"){
+				useCache = vals.empty() || Configuration::parseBool(vals[0]);
+			}
+			if(name == "stream"){
+				streamNotes = vals.empty() || Configuration::parseBool(vals[0]);
+			}
+			if(name == "keep-events"){
+				keepEvents = vals.empty() || Configuration::parseBool(vals[0]);
+			}
+			if(name == "note-overlap" && vals.size() >= 1){
+				if(vals[0] == "RETRIGGER"){
+					noteOverlap = NoteOverlap::RETRIGGER;
+				} else if(vals[0] == "FIFO"){
+					noteOverlap = NoteOverlap::FIFO;
+				} else if(vals[0] == "LIFO"){
+					noteOverlap = NoteOverlap::LIFO;
+				} else {
+					std::cerr << "[CONFIG]: Unknown note overlap " << vals[0] << ", expected RETRIGGER, FIFO or LIFO." << std::endl;
+				}
+			}
 
 			if(name == "fullscreen"){
 				fullscreen = vals.empty() || Configuration::parseBool(vals[0]);
@@ -240,6 +264,12 @@ void Configuration::save(const std::string& path){
 	outFile << "size " << windowSize[0] << " " << windowSize[1] << "\n";
 	outFile << "position " << windowPos[0] << " " << windowPos[1] << "\n";
 	outFile << "gui-size " << guiScale << "\n";
+	outFile << "threads " << threadsCount << "\n";
+	const std::vector<std::string> overlapNames = { "RETRIGGER", "FIFO", "LIFO" };
+	outFile << "note-overlap " << overlapNames[int(noteOverlap)] << "\n";
+	outFile << "cache " << useCache << "\n";
+	outFile << "stream " << streamNotes << "\n";
+	outFile << "keep-events " << keepEvents << "\n";
 	outFile << "fullscreen " << fullscreen << "\n";
 	outFile << "hide-window " << hideWindow << "\n";
 	outFile << "forbid-transparency " << preventTransparency << "\n";
@@ -266,6 +296,11 @@ void Configuration::printHelp(){
 		{"position", "position of the window (--position X Y)"},
 		{"fullscreen", "start in fullscreen (1 or 0 to enable/disable)"},
 		{"gui-size", "GUI text and button scaling (number, default 1.0)"},
+		{"threads", "number of threads used when loading files (integer, default 0 to use all available)"},
+		{"note-overlap", "pairing of repeated notes on the same key (values: RETRIGGER, FIFO, LIFO)"},
+		{"cache", "keep parsed MIDI files on disk to speed up reloading them (1 or 0 to enable/disable)"},
+		{"stream", "only keep notes around the current time in memory, for very large MIDI files (1 or 0 to enable/disable)"},
+		{"keep-events", "keep all MIDI events in memory to print them from the debug panel (1 or 0 to enable/disable)"},
 		{"transparency", "enable transparent window background if supported (1 or 0 to enable/disable)"},
 		{"forbid-transparency", "prevent transparent window background (1 or 0 to enable/disable)"},
 		{"help", "display this help message"},
@@ -5,6 +5,10 @@
 #include <vector>
 #include <unordered_map>
 #include <glm/glm.hpp>
+#include <cstdint>
+
+// Defined in midi/MIDIUtils.h.
+enum class NoteOverlap : uint8_t;
 
 typedef std::unordered_map<std::string, std::vector<std::string>> Arguments;
 
@@ -66,6 +70,11 @@ public:
 	glm::ivec2 windowSize = { 1280, 600 };
 	glm::ivec2 windowPos = {100, 100};
 	float guiScale = 1.0f;
+	int threadsCount = 0;
+	NoteOverlap noteOverlap;
+	bool useCache = false;
+	bool streamNotes = false;
+	bool keepEvents = false;
 	bool fullscreen = false;
 	bool hideWindow = false;
 	bool preventTransparency = false;
@@ -0,0 +1,117 @@
+#include "MappedFile.h"
+#include "System.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#undef APIENTRY
+#define NOMINMAX
+#include <windows.h>
+// Defined in System.cpp.
+wchar_t * widen(const std::string & str);
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string & path){
+
+#ifdef _WIN32
+	wchar_t* str = widen(path);
+	HANDLE file = CreateFileW(str, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	delete[] str;
+
+	if(file != INVALID_HANDLE_VALUE){
+		LARGE_INTEGER fileSize;
+		if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0){
+			HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if(mapping != nullptr){
+				void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				if(view != nullptr){
+					_fileHandle = file;
+					_mappingHandle = mapping;
+					_data = static_cast<const uint8_t*>(view);
+					_size = size_t(fileSize.QuadPart);
+					_mapped = true;
+					_valid = true;
+					return;
+				}
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+	}
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if(file >= 0){
+		struct stat infos;
+		if(fstat(file, &infos) == 0 && infos.st_size > 0){
+			void* view = mmap(nullptr, size_t(infos.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+			if(view != MAP_FAILED){
+				// The file will be parsed front to back.
+				madvise(view, size_t(infos.st_size), MADV_SEQUENTIAL);
+				_data = static_cast<const uint8_t*>(view);
+				_size = size_t(infos.st_size);
+				_mapped = true;
+				_valid = true;
+			}
+		}
+		// The mapping stays valid after closing the descriptor.
+		close(file);
+		if(_valid){
+			return;
+		}
+	}
+#endif
+
+	// Mapping failed (empty file, special file system,...), fallback to a plain read.
+	_valid = loadInBuffer(path);
+}
+
+bool MappedFile::loadInBuffer(const std::string & path){
+	std::ifstream input = System::openInputFile(path, true);
+	if(!input.is_open()){
+		return false;
+	}
+	// Read everything at once instead of going through stream iterators.
+	input.seekg(0, std::ios::end);
+	const std::streamoff length = input.tellg();
+	input.seekg(0, std::ios::beg);
+	if(length < 0){
+		return false;
+	}
+	_buffer.resize(size_t(length));
+	if(length > 0){
+		input.read(reinterpret_cast<char*>(_buffer.data()), length);
+	}
+	input.close();
+
+	_data = _buffer.data();
+	_size = _buffer.size();
+	_mapped = false;
+	return true;
+}
+
+void MappedFile::unmap(){
+	if(!_mapped){
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(_data);
+	CloseHandle(static_cast<HANDLE>(_mappingHandle));
+	CloseHandle(static_cast<HANDLE>(_fileHandle));
+	_mappingHandle = nullptr;
+	_fileHandle = nullptr;
+#else
+	munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+	_mapped = false;
+	_data = nullptr;
+	_size = 0;
+}
+
+MappedFile::~MappedFile(){
+	unmap();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ \brief Read-only view on the content of a file on disk. The file is memory-mapped when the platform allows it,
+ else its content is read in a single pass into an internal buffer.
+ \ingroup System
+ */
+class MappedFile {
+public:
+
+	/** Open and map a file.
+	 \param path the path to the file on disk
+	 */
+	MappedFile(const std::string & path);
+
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	/** \return true if the file content is available. */
+	bool isValid() const { return _valid; }
+
+	/** \return true if the content is memory-mapped, false if it was copied in a buffer. */
+	bool isMapped() const { return _mapped; }
+
+	/** \return a pointer to the first byte of the file. */
+	const uint8_t * data() const { return _data; }
+
+	/** \return the size of the file in bytes. */
+	size_t size() const { return _size; }
+
+private:
+
+	/** Release the mapping if any. */
+	void unmap();
+
+	/** Load the whole file in the internal buffer.
+	 \param path the path to the file on disk
+	 \return true if the file was read successfully
+	 */
+	bool loadInBuffer(const std::string & path);
+
+	std::vector<uint8_t> _buffer; ///< Fallback storage when mapping is not possible.
+	const uint8_t * _data = nullptr;
+	size_t _size = 0;
+	bool _valid = false;
+	bool _mapped = false;
+
+#ifdef _WIN32
+	void * _fileHandle = nullptr;
+	void * _mappingHandle = nullptr;
+#endif
+};
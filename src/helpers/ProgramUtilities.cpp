@@ -96,7 +96,7 @@ GLuint createGLProgram(const std::string & vertexPath, const std::string & fragm
 	return createGLProgramFromStrings(vertexCode, fragmentCode, geometryCode);
 }
 
-GLuint createGLProgramFromStrings(const std::string & vertexContent, const std::string & fragmentContent, const std::string & geometryContent){
+GLuint createGLProgramFromStrings(const std::string & vertexContent, const std::string & fragmentContent, const std::string & geometryContent, const std::vector<std::string> & feedbackOutputs){
 	GLuint vp(0), fp(0), gp(0), id(0);
 	id = glCreateProgram();
 	checkGLError();
@@ -119,6 +119,14 @@ GLuint createGLProgramFromStrings(const std::string & vertexContent, const std::
 		gp = loadShader(geometryCode,GL_GEOMETRY_SHADER);
 		glAttachShader(id,gp);
 	}
+	// Outputs to capture have to be known before linking.
+	if (!feedbackOutputs.empty()) {
+		std::vector<const char *> names;
+		for (const auto & output : feedbackOutputs) {
+			names.push_back(output.c_str());
+		}
+		glTransformFeedbackVaryings(id, GLsizei(names.size()), &names[0], GL_INTERLEAVED_ATTRIBS);
+	}
 	
 	
 	// Link everything
@@ -21,7 +21,8 @@ GLuint loadShader(const std::string & prog, GLuint type);
 /// Create a GLProgram using the hader code contained in the given files.
 GLuint createGLProgram(const std::string & vertexPath, const std::string & fragmentPath, const std::string & geometryPath = "");
 
-GLuint createGLProgramFromStrings(const std::string & vertexContent, const std::string & fragmentContent, const std::string & geometryContent = "");
+/// Create a GLProgram from shader code, optionally capturing the given vertex outputs in a transform feedback buffer (interleaved).
+GLuint createGLProgramFromStrings(const std::string & vertexContent, const std::string & fragmentContent, const std::string & geometryContent = "", const std::vector<std::string> & feedbackOutputs = std::vector<std::string>());
 
 // Texture loading.
 
@@ -3,6 +3,12 @@
 #include <iomanip>
 #include <sstream>
 #include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <exception>
 
 #include <GLFW/glfw3.h>
 
@@ -203,3 +209,64 @@ void System::writeStringToFile(const std::string& path, const std::string& conte
 		file.close();
 	}
 }
+
+unsigned int System::_workerThreadsCount = 0;
+
+void System::setWorkerThreadsCount(unsigned int count){
+	_workerThreadsCount = count;
+}
+
+unsigned int System::workerThreadsCount(){
+	if(_workerThreadsCount != 0){
+		return _workerThreadsCount;
+	}
+	// Can return 0 if unknown.
+	return (std::max)(std::thread::hardware_concurrency(), 1u);
+}
+
+void System::forParallel(size_t first, size_t last, const std::function<void(size_t)> & func){
+	if(last <= first){
+		return;
+	}
+	const size_t count = last - first;
+	const size_t threadsCount = (std::min)(size_t(workerThreadsCount()), count);
+
+	// Each thread picks the next available index.
+	std::atomic<size_t> next(first);
+	std::exception_ptr error = nullptr;
+	std::mutex errorMutex;
+
+	auto worker = [&](){
+		while(true){
+			const size_t index = next.fetch_add(1);
+			if(index >= last){
+				break;
+			}
+			try {
+				func(index);
+			} catch(...){
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if(!error){
+					error = std::current_exception();
+				}
+				// Skip the remaining indices.
+				next = last;
+			}
+		}
+	};
+
+	// The calling thread also participates.
+	std::vector<std::thread> threads;
+	threads.reserve(threadsCount - 1);
+	for(size_t tid = 1; tid < threadsCount; ++tid){
+		threads.emplace_back(worker);
+	}
+	worker();
+	for(std::thread & thread : threads){
+		thread.join();
+	}
+
+	if(error){
+		std::rethrow_exception(error);
+	}
+}
@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <string>
+#include <functional>
 
 /**
  \brief Performs system basic operations such as directory creation, timing, threading, file picking.
@@ -39,5 +40,26 @@ public:
 	static bool createDirectory(const std::string & directory);
 	
 	static std::string getApplicationDataDirectory();
+
+	/** Set the number of threads used by parallel tasks.
+	 \param count the number of threads, or 0 to use all available hardware threads
+	 */
+	static void setWorkerThreadsCount(unsigned int count);
+
+	/** \return the number of threads used by parallel tasks. */
+	static unsigned int workerThreadsCount();
+
+	/** Call a function on each index of a range, using the worker threads. Indices are distributed dynamically,
+	 so the function should only write to locations that depend on the index it receives.
+	 \param first the first index
+	 \param last the index after the last one
+	 \param func the function to call
+	 \note If one of the calls throws, the first exception is rethrown on the calling thread once all threads are done.
+	 */
+	static void forParallel(size_t first, size_t last, const std::function<void(size_t)> & func);
+
+private:
+
+	static unsigned int _workerThreadsCount; ///< Number of threads requested (0 for automatic).
 	
 };
@@ -7,6 +7,7 @@
 #include "helpers/System.h"
 
 #include "rendering/Renderer.h"
+#include "midi/MIDIFile.h"
 
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_glfw.h>
@@ -48,7 +49,7 @@ void drop_callback(GLFWwindow* window, int count, const char** paths){
 	}
 
 	Renderer *renderer = static_cast<Renderer*>(glfwGetWindowUserPointer(window));
-	bool loadedMIDI = false;
+	std::vector<std::string> midiPaths;
 	bool loadedConfig = false;
 	for(unsigned int i = 0; i < count; ++i){
 		std::string path(paths[i]);
@@ -66,9 +67,9 @@ void drop_callback(GLFWwindow* window, int count, const char** paths){
 		// Determine path file type.
 		const bool isMIDI = extension == "mid" || extension == "midi";
 		const bool isConfig = extension == "ini" || extension == "config";
-		// Attempt to load MIDI if not already loaded.
-		if(!loadedMIDI && isMIDI){
-			loadedMIDI = renderer->loadFile(path);
+		// Collect MIDI files, only the first one that loads will be kept.
+		if(isMIDI){
+			midiPaths.push_back(path);
 		}
 		// Attempt to load state if not already loaded.
 		if(!loadedConfig && isConfig){
@@ -79,6 +80,8 @@ void drop_callback(GLFWwindow* window, int count, const char** paths){
 			}
 		}
 	}
+	// Load in the background to keep the window responsive.
+	renderer->loadFilesAsync(midiPaths);
 }
 
 /// Perform system window action.
@@ -168,6 +171,13 @@ int main( int argc, char** argv) {
 		glfwTerminate();
 		return 0;
 	}
+	System::setWorkerThreadsCount((unsigned int)config.threadsCount);
+	if(config.useCache){
+		const std::string cachePath = applicationDataPath + "cache/";
+		System::createDirectory(cachePath);
+		MIDIFile::setCacheDirectory(cachePath);
+	}
+	MIDIFile::setKeepEvents(config.keepEvents);
 	
 	// On OS X, the correct OpenGL profile and version to use have to be explicitely defined.
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
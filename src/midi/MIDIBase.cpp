@@ -1,13 +1,35 @@
 #include "MIDIBase.h"
+#include "TempoMap.h"
 
-MIDINote::MIDINote(short aNote, double aStart, double aDuration, short aVelocity, short aChannel, unsigned int trackId) : start(aStart), duration(aDuration), track(trackId), set(0), note(aNote), velocity(aVelocity), channel(aChannel) {
+static_assert(sizeof(MIDINote) == 16, "Notes should stay compact.");
 
+// Units are stored on 32 bits, enough for hours at the finest resolutions.
+static uint32_t toStoredUnits(size_t units){
+	return uint32_t((std::min)(units, size_t(UINT32_MAX)));
 }
 
-MIDIEvent::MIDIEvent(EventCategory aCategory, uint8_t aType, size_t aDelta, std::vector<short> aData) : category(aCategory), type(aType), delta(aDelta), data(aData) {
+MIDINote::MIDINote(){
 
 }
 
+MIDINote::MIDINote(short aNote, size_t aStart, size_t aEnd, short aVelocity, short aChannel, unsigned int trackId) : startUnits(toStoredUnits(aStart)), endUnits(toStoredUnits(aEnd)), track(uint16_t(trackId)), set(0), note(uint8_t(aNote)), velocity(uint8_t(aVelocity)), channel(uint8_t(aChannel)) {
+
+}
+
+double MIDINote::start(const TempoMap & tempos) const {
+	return tempos.secondsAt(startUnits);
+}
+
+double MIDINote::duration(const TempoMap & tempos) const {
+	return tempos.secondsAt(endUnits) - tempos.secondsAt(startUnits);
+}
+
+double MIDINote::end(const TempoMap & tempos) const {
+	// Same rounding as when durations were stored.
+	const double noteStart = start(tempos);
+	return noteStart + (tempos.secondsAt(endUnits) - noteStart);
+}
+
 MIDITempo::MIDITempo(){
 
 }
@@ -16,25 +38,29 @@ MIDITempo::MIDITempo(size_t astart, unsigned int atempo) : start(astart), tempo(
 	
 }
 
+MIDIPedal::MIDIPedal(){
+
+}
+
 MIDIPedal::MIDIPedal(PedalType aType, double aStart, double aDuration, float aVelocity) : start(aStart), duration(aDuration), type(aType), velocity(aVelocity) {
 
 }
 
 void MIDINote::print() const {
-	std::cout << "[INFO]: Note " << note << " (" << duration << "s at "<< start << "s), on channel " << channel << " with velocity " << velocity << "." << std::endl;
+	std::cout << "[INFO]: Note " << int(note) << " (" << (endUnits - startUnits) << "u at "<< startUnits << "u), on channel " << int(channel) << " with velocity " << int(velocity) << "." << std::endl;
 }
 
 void MIDIEvent::print() const {
 	if(category == EventCategory::SYSTEM){
-		std::cout << "[INFO]: " << "Sysex event (" << delta << "): type is "<< std::hex << std::showbase << type << std::dec << ", length is " << data.size() << std::endl;
+		std::cout << "[INFO]: " << "Sysex event (" << delta << "): type is "<< std::hex << std::showbase << type << std::dec << ", length is " << size << std::endl;
 	} else if (category == EventCategory::META){
-		std::cout << "[INFO]: " << "Meta event (" << delta << "): type is " << metaEventTypeName[static_cast<MetaEventType>(type)] << ", length is " << data.size() << std::endl;
+		std::cout << "[INFO]: " << "Meta event (" << delta << "): type is " << metaEventTypeName[static_cast<MetaEventType>(type)] << ", length is " << size << std::endl;
 	} else if (category == EventCategory::MIDI){
 		const auto typeName = MIDIEventTypeName.find(static_cast<MIDIEventType>(type));
 		if(typeName != MIDIEventTypeName.end()){
-			std::cout << "[INFO]: " << "MIDI Event " << typeName->second << " (" << delta << ") on channel " << data[0] << " with note " << data[1] << " and velocity " << data[2] << "." << std::endl;
+			std::cout << "[INFO]: " << "MIDI Event " << typeName->second << " (" << delta << ") on channel " << int(channel) << " with note " << int(note) << " and velocity " << int(velocity) << "." << std::endl;
 		} else {
-			std::cout << "[INFO]: " << "MIDI Event unknown (" << delta << "), data size " << data.size() << "." << std::endl;
+			std::cout << "[INFO]: " << "MIDI Event unknown (" << delta << "), data size 3." << std::endl;
 		}
 	}
 }
@@ -43,86 +69,229 @@ void MIDITempo::print() const {
 	std::cout << "[INFO]: Tempo " << tempo << " (at "<< start << "u, " << timestamp << "us)." << std::endl;
 }
 
+void MIDIStatistics::addNote(const MIDINote & note, double start, double noteDuration){
+	duration = (std::max)(duration, start + noteDuration);
+	++notesCount;
+	minKey = (std::min)(minKey, short(note.note));
+	maxKey = (std::max)(maxKey, short(note.note));
+	++channelCounts[note.channel & 0xF];
+	const size_t second = size_t((std::max)(start, 0.0));
+	if(second >= density.size()){
+		density.resize(second + 1, 0);
+	}
+	++density[second];
+}
+
+void MIDIStatistics::merge(const MIDIStatistics & other){
+	duration = (std::max)(duration, other.duration);
+	notesCount += other.notesCount;
+	minKey = (std::min)(minKey, other.minKey);
+	maxKey = (std::max)(maxKey, other.maxKey);
+	for(size_t cid = 0; cid < channelCounts.size(); ++cid){
+		channelCounts[cid] += other.channelCounts[cid];
+	}
+	maxTrackPolyphony = (std::max)(maxTrackPolyphony, other.maxTrackPolyphony);
+	if(other.density.size() > density.size()){
+		density.resize(other.density.size(), 0);
+	}
+	for(size_t sid = 0; sid < other.density.size(); ++sid){
+		density[sid] += other.density[sid];
+	}
+}
+
+void MIDIStatistics::print() const {
+	std::cout << "[INFO]: " << notesCount << " notes over " << duration << "s";
+	if(notesCount > 0){
+		std::cout << ", keys " << minKey << " to " << maxKey;
+	}
+	if(maxPolyphony > 0){
+		std::cout << ", up to " << maxPolyphony << " notes held at once." << std::endl;
+	} else {
+		std::cout << ", up to " << maxTrackPolyphony << " notes held at once in a track." << std::endl;
+	}
+	std::cout << "[INFO]: Notes per channel:";
+	for(size_t cid = 0; cid < channelCounts.size(); ++cid){
+		if(channelCounts[cid] > 0){
+			std::cout << " " << cid << " (" << channelCounts[cid] << ")";
+		}
+	}
+	std::cout << "." << std::endl;
+	const uint32_t peak = density.empty() ? 0 : *std::max_element(density.begin(), density.end());
+	std::cout << "[INFO]: Up to " << peak << " notes starting per second." << std::endl;
+}
+
 void MIDIPedal::print() const {
 	std::cout << "[INFO]: Pedal " << int(type) << " (at "<< start << "s, " << duration << "s) with velocity " << velocity << "." << std::endl;
 }
 
-MIDIEvent MIDIEvent::readMIDIEvent(const std::vector<char> & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte){
+void MIDIEventList::reserve(size_t count){
+	_deltas.reserve(count);
+	_categories.reserve(count);
+	_types.reserve(count);
+	_payloads.reserve(count);
+}
 
-	uint8_t firstByte = read8(buffer, position);
-	size_t positionOffset = 1;
+MIDIEventReader::MIDIEventReader(const ByteSpan & buffer, size_t position, uint8_t previousFirstByte) : _buffer(buffer), _position(position), _previousFirstByte(previousFirstByte) {
 
-	MIDIEventType type = static_cast<MIDIEventType>((firstByte & 0xF0) >> 4);
-	/*if (type == ignoreType) {
-		position += positionOffset;
-		return MIDIEvent(midiEvent, static_cast<uint8_t>(type), delta, {});
-	}*/
+}
 
-	uint8_t secondByte = read8(buffer, position+1);
-	uint8_t thirdByte = 0;
-	positionOffset += 1;
-	if(type != programChange && type != channelPressure){
-		thirdByte = read8(buffer, position+2);
-		positionOffset += 1;
+bool MIDIEventReader::next(MIDIEvent & event){
+	if(_position >= _buffer.size){
+		return false;
 	}
-
-	if(MIDIEventTypeName.count(type) == 0){
-		thirdByte = secondByte;
-		secondByte = firstByte;
-		firstByte = previousFirstByte;
-		positionOffset -= 1;
+	event.delta = readVarLen(_buffer, _position);
+	const uint8_t eventMetaType = read8(_buffer, _position);
+
+	if(eventMetaType == 0xFF){
+		readMetaEvent(event);
+	} else if (eventMetaType >= 0xF0 && eventMetaType <= 0xF7){
+		readSysexEvent(event);
+	}  else {
+		readMIDIEvent(event);
 	}
+	return true;
+}
 
-	type = static_cast<MIDIEventType>((firstByte & 0xF0) >> 4);
-
-	short channel = firstByte & 0x0F;
-
-	short note = short(secondByte);
-	short velocity = short(thirdByte);
+bool MIDIEventReader::nextMeta(MIDIEvent & event){
+	size_t delta = 0;
+	while(_position < _buffer.size){
+		delta += readVarLen(_buffer, _position);
+		const uint8_t eventMetaType = read8(_buffer, _position);
+
+		if(eventMetaType == 0xFF){
+			readMetaEvent(event);
+			event.delta = delta;
+			return true;
+		} else if (eventMetaType >= 0xF0 && eventMetaType <= 0xF7){
+			skipSysexEvent();
+		}  else {
+			skipMIDIEvent();
+		}
+	}
+	return false;
+}
 
-	std::vector<short> data;
-	data.push_back(channel);
-	data.push_back(note);
-	data.push_back(velocity);
+uint8_t MIDIEventReader::skipMIDIEvent(){
+	const uint8_t firstByte = read8(_buffer, _position);
+	const uint8_t type = (firstByte & 0xF0) >> 4;
+	// Without a status byte, reuse the previous one. The two following bytes are then data.
+	const bool runningStatus = firstByte < 0x80;
+	const size_t length = (runningStatus || (type != programChange && type != channelPressure)) ? 3 : 2;
+	checkBounds(_buffer, _position, length);
 
-	previousFirstByte = firstByte;
-	position += positionOffset;
+	if(!runningStatus){
+		_previousFirstByte = firstByte;
+	}
+	_position += runningStatus ? length - 1 : length;
+	return _previousFirstByte;
+}
 
-	return MIDIEvent(EventCategory::MIDI, static_cast<uint8_t>(type), delta, data);
+void MIDIEventReader::readMIDIEvent(MIDIEvent & event){
+	const size_t start = _position;
+	const uint8_t status = skipMIDIEvent();
+	// Data bytes start right away if the status byte was omitted.
+	const size_t dataStart = _buffer.data[start] < 0x80 ? start : start + 1;
+
+	event.category = EventCategory::MIDI;
+	event.type = (status & 0xF0) >> 4;
+	event.channel = status & 0x0F;
+	event.note = _buffer.data[dataStart];
+	event.velocity = dataStart + 1 < _position ? _buffer.data[dataStart + 1] : 0;
+	event.data = nullptr;
+	event.size = 0;
 }
 
 
-MIDIEvent MIDIEvent::readMetaEvent(const std::vector<char> & buffer, size_t & position, size_t delta){
-	position += 1; // We already read FF.
-	MetaEventType type = static_cast<MetaEventType>(read8(buffer, position));
-	position += 1;
+void MIDIEventReader::readMetaEvent(MIDIEvent & event){
+	_position += 1; // We already read FF.
+	const MetaEventType type = static_cast<MetaEventType>(read8(_buffer, _position));
+	_position += 1;
 
-	size_t length = readVarLen(buffer, position);
+	const size_t length = readVarLen(_buffer, _position);
+	checkBounds(_buffer, _position, length);
 
-	std::vector<short> data;
-	for(size_t i = 0; i < length; ++i){
-		data.push_back(short(read8(buffer, position + i)));
-	}
+	event.category = EventCategory::META;
+	event.type = static_cast<uint8_t>(type);
+	event.channel = event.note = event.velocity = 0;
+	event.data = _buffer.data + _position;
+	event.size = length;
+	_position = _position + length;
+}
 
-	position = position + length;
 
-	return MIDIEvent(EventCategory::META, static_cast<uint8_t>(type), delta, data);
+void MIDIEventReader::skipSysexEvent(){
+	_position += 1;
+	const size_t length = readVarLen(_buffer, _position);
+	checkBounds(_buffer, _position, length);
+	_position += length;
 }
 
+void MIDIEventReader::readSysexEvent(MIDIEvent & event){
+	const uint8_t type = read8(_buffer, _position);
+	_position += 1;
 
-MIDIEvent MIDIEvent::readSysexEvent(const std::vector<char> & buffer, size_t & position, size_t delta){
-	uint8_t type = read8(buffer, position);
-	position += 1;
+	const size_t length = readVarLen(_buffer, _position);
+	checkBounds(_buffer, _position, length);
 
-	size_t length = readVarLen(buffer,position);
+	event.category = EventCategory::SYSTEM;
+	event.type = type;
+	event.channel = event.note = event.velocity = 0;
+	event.data = _buffer.data + _position;
+	event.size = length;
+	_position = _position + length;
+}
 
-	std::vector<short> data;
-	for(size_t i = 0; i < length; ++i){
-		data.push_back(short(read8(buffer, position + i)));
+void MIDIEventList::push(const MIDIEvent & event){
+	_deltas.push_back(uint32_t(event.delta));
+	_categories.push_back(event.category);
+	_types.push_back(event.type);
+	if(event.category == EventCategory::MIDI){
+		_payloads.push_back(uint32_t(event.channel) | (uint32_t(event.note) << 8) | (uint32_t(event.velocity) << 16));
+		return;
 	}
+	// Copy the payload at the end of the pool.
+	_pool.insert(_pool.end(), event.data, event.data + event.size);
+	_payloads.push_back(uint32_t(_poolOffsets.size() - 1));
+	_poolOffsets.push_back(uint32_t(_pool.size()));
+}
 
-	position = position + length;
+MIDIEvent MIDIEventList::operator[](size_t i) const {
+	MIDIEvent event;
+	event.category = _categories[i];
+	event.type = _types[i];
+	event.delta = _deltas[i];
+	const uint32_t payload = _payloads[i];
+	if(event.category == EventCategory::MIDI){
+		event.channel = uint8_t(payload & 0xFF);
+		event.note = uint8_t((payload >> 8) & 0xFF);
+		event.velocity = uint8_t((payload >> 16) & 0xFF);
+		event.data = nullptr;
+		event.size = 0;
+	} else {
+		event.channel = event.note = event.velocity = 0;
+		event.data = _pool.data() + _poolOffsets[payload];
+		event.size = _poolOffsets[payload + 1] - _poolOffsets[payload];
+	}
+	return event;
+}
 
-	return MIDIEvent(EventCategory::SYSTEM, type, delta, data);
+size_t MIDIEventList::memorySize() const {
+	return _deltas.capacity() * sizeof(uint32_t) + _categories.capacity() * sizeof(EventCategory)
+		+ _types.capacity() * sizeof(uint8_t) + _payloads.capacity() * sizeof(uint32_t)
+		+ _poolOffsets.capacity() * sizeof(uint32_t) + _pool.capacity() * sizeof(uint8_t);
 }
 
+size_t MIDIEventList::unpackedMemorySize() const {
+	// One struct (category, type and delta with padding, then a std::vector<short>) per event,
+	// and one heap block per payload. Assume the allocator rounds to 16 bytes and adds 16 bytes of bookkeeping.
+	const size_t structSize = 16 + sizeof(std::vector<short>);
+	const size_t count = size();
+	size_t total = count * structSize;
+	for(size_t i = 0; i < count; ++i){
+		const size_t length = _categories[i] == EventCategory::MIDI ? 3 : (_poolOffsets[_payloads[i] + 1] - _poolOffsets[_payloads[i]]);
+		if(length > 0){
+			total += ((length * sizeof(short) + 15) / 16) * 16 + 16;
+		}
+	}
+	return total;
+}
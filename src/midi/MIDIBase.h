@@ -3,23 +3,39 @@
 
 #include "MIDIUtils.h"
 
+class TempoMap;
+
+/// Note stored in 16 bytes. Times are kept in MIDI units, converted to seconds with the tempo map of the file.
 struct MIDINote {
 
-	MIDINote(short aNote, double aStart, double aDuration, short aVelocity, short aChannel, unsigned int trackId);
+	MIDINote();
+
+	MIDINote(short aNote, size_t aStart, size_t aEnd, short aVelocity, short aChannel, unsigned int trackId);
+
+	/// \return the start time in seconds
+	double start(const TempoMap & tempos) const;
+
+	/// \return the duration in seconds
+	double duration(const TempoMap & tempos) const;
+
+	/// \return the end time in seconds, start plus duration
+	double end(const TempoMap & tempos) const;
 
 	void print() const;
 
-	double start;
-	double duration;
-	unsigned int track;
-	int set;
-	short note;
-	short velocity;
-	short channel;
+	uint32_t startUnits;
+	uint32_t endUnits;
+	uint16_t track;
+	uint8_t set;
+	uint8_t note;
+	uint8_t velocity;
+	uint8_t channel;
 };
 
 struct MIDIPedal {
 
+	MIDIPedal();
+
 	MIDIPedal(PedalType aType, double aStart, double aDuration, float velocity);
 
 	void print() const;
@@ -30,23 +46,114 @@ struct MIDIPedal {
 	PedalType type;
 };
 
-struct MIDIEvent {
+/// Summary of the notes of a track or file, gathered while extracting notes.
+struct MIDIStatistics {
+
+	/// Register a note, with its timings in seconds.
+	void addNote(const MIDINote & note, double start, double noteDuration);
 
-	MIDIEvent(EventCategory aCategory, uint8_t aType, size_t aDelta, std::vector<short> aData);
+	/// Combine with the statistics of another track.
+	void merge(const MIDIStatistics & other);
 
 	void print() const;
 
-	static MIDIEvent readMIDIEvent(const std::vector<char> & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte);
+	double duration = 0.0;
+	size_t notesCount = 0;
+	short minKey = 127; ///< Lowest MIDI key played.
+	short maxKey = 0; ///< Highest MIDI key played.
+	std::array<size_t, 16> channelCounts = {}; ///< Notes per channel.
+	size_t maxPolyphony = 0; ///< Peak count of notes held at once over all tracks, zero if unknown.
+	size_t maxTrackPolyphony = 0; ///< Peak count of notes held at once in a single track.
+	std::vector<uint32_t> density; ///< Notes starting during each second.
+};
 
-	static MIDIEvent readMetaEvent(const std::vector<char> & buffer, size_t & position, size_t delta);
+/// Lightweight view on an event stored in a MIDIEventList.
+struct MIDIEvent {
 
-	static MIDIEvent readSysexEvent(const std::vector<char> & buffer, size_t & position, size_t delta);
+	void print() const;
 
 	EventCategory category;
 	uint8_t type;
 	size_t delta;
-	std::vector<short> data;
+	// MIDI events only.
+	uint8_t channel;
+	uint8_t note;
+	uint8_t velocity;
+	// Meta and sysex events only, points into the list byte pool.
+	const uint8_t * data;
+	size_t size;
+
+};
+
+/// Decode the events of a track one after the other, directly from its bytes.
+class MIDIEventReader {
+public:
+
+	/// Start reading at a given position, with the status byte of the previous MIDI event for running status.
+	MIDIEventReader(const ByteSpan & buffer, size_t position = 0, uint8_t previousFirstByte = 0);
+
+	/// Decode the next event. Meta and sysex payloads point into the buffer.
+	/// \return false if the end of the track was reached
+	bool next(MIDIEvent & event);
+
+	/// Decode the next meta event, skipping other events. Its delta includes the ones of skipped events.
+	/// \return false if the end of the track was reached
+	bool nextMeta(MIDIEvent & event);
 
+	size_t position() const { return _position; }
+
+	uint8_t previousFirstByte() const { return _previousFirstByte; }
+
+private:
+
+	void readMIDIEvent(MIDIEvent & event);
+
+	/// Skip a MIDI event, resolving running status.
+	/// \return the status byte of the event
+	uint8_t skipMIDIEvent();
+
+	void skipSysexEvent();
+
+	void readMetaEvent(MIDIEvent & event);
+
+	void readSysexEvent(MIDIEvent & event);
+
+	ByteSpan _buffer;
+	size_t _position = 0;
+	uint8_t _previousFirstByte = 0x0;
+};
+
+/// Compact storage for all the events of a track, as a structure of arrays.
+/// Fixed-size MIDI events are packed inline, meta and sysex payloads are stored
+/// as ranges in a single byte pool shared by all events of the list.
+class MIDIEventList {
+public:
+
+	/// Append an event, copying its payload if any.
+	void push(const MIDIEvent & event);
+
+	void reserve(size_t count);
+
+	size_t size() const { return _deltas.size(); }
+
+	MIDIEvent operator[](size_t i) const;
+
+	/// Bytes used by the list.
+	size_t memorySize() const;
+
+	/// Estimation of the bytes that the same events would use with one heap-allocated payload each.
+	size_t unpackedMemorySize() const;
+
+private:
+
+	std::vector<uint32_t> _deltas;
+	std::vector<EventCategory> _categories;
+	std::vector<uint8_t> _types;
+	/// Channel, note and velocity for MIDI events, index in _poolOffsets for other events.
+	std::vector<uint32_t> _payloads;
+	/// Start of each variable-length payload in the pool, followed by the end of the last one.
+	std::vector<uint32_t> _poolOffsets = { 0 };
+	std::vector<uint8_t> _pool;
 };
 
 struct MIDITempo {
@@ -70,4 +177,6 @@ struct ActiveNoteInfos {
 	bool enabled = false;
 };
 
+typedef std::array<ActiveNoteInfos, 128> ActiveNotesArray;
+
 #endif // MIDI_BASE_H
@@ -0,0 +1,71 @@
+#include "MIDICache.h"
+#include "../helpers/System.h"
+
+#include <cstring>
+#include <cstdio>
+
+uint64_t hashBytes(const ByteSpan & buffer){
+	uint64_t hash = 14695981039346656037ull;
+	for(size_t i = 0; i < buffer.size; ++i){
+		hash ^= uint64_t(buffer.data[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static size_t alignedSize(size_t size){
+	return (size + 7) & ~size_t(7);
+}
+
+void CacheWriter::writeBytes(const void * data, size_t size){
+	const size_t position = _data.size();
+	_data.resize(position + alignedSize(size), 0);
+	if(size > 0){
+		std::memcpy(_data.data() + position, data, size);
+	}
+}
+
+void CacheWriter::writeString(const std::string & str){
+	write(uint64_t(str.size()));
+	writeBytes(str.data(), str.size());
+}
+
+bool CacheWriter::save(const std::string & path) const {
+	const std::string tempPath = path + ".tmp";
+	std::ofstream output = System::openOutputFile(tempPath, true);
+	if(!output.is_open()){
+		return false;
+	}
+	output.write(reinterpret_cast<const char*>(_data.data()), std::streamsize(_data.size()));
+	const bool success = output.good();
+	output.close();
+	// Another instance might be writing the same cache, the last complete one wins.
+	std::remove(path.c_str());
+	if(!success || std::rename(tempPath.c_str(), path.c_str()) != 0){
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool CacheReader::readBytes(void * data, size_t size){
+	const size_t paddedSize = alignedSize(size);
+	if(paddedSize > _buffer.size - _position){
+		return false;
+	}
+	if(size > 0){
+		std::memcpy(data, _buffer.data + _position, size);
+	}
+	_position += paddedSize;
+	return true;
+}
+
+bool CacheReader::readString(std::string & str){
+	uint64_t size = 0;
+	if(!read(size) || size > _buffer.size - _position){
+		return false;
+	}
+	str.assign(reinterpret_cast<const char*>(_buffer.data + _position), size_t(size));
+	_position += alignedSize(size_t(size));
+	return _position <= _buffer.size;
+}
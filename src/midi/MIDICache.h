@@ -0,0 +1,76 @@
+#ifndef MIDI_CACHE_H
+#define MIDI_CACHE_H
+
+#include "MIDIUtils.h"
+
+#include <type_traits>
+
+/// Increment when the parser output or the cache layout changes, to invalidate existing caches.
+#define MIDI_CACHE_VERSION 2
+
+/// Hash a range of bytes (64-bit FNV-1a).
+uint64_t hashBytes(const ByteSpan & buffer);
+
+/// Build a binary cache in memory. Every block is aligned on 8 bytes so that arrays can be read in place once mapped.
+class CacheWriter {
+public:
+
+	void writeBytes(const void * data, size_t size);
+
+	template<typename T>
+	void write(const T & value){
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be cached.");
+		writeBytes(&value, sizeof(T));
+	}
+
+	template<typename T>
+	void writeArray(const std::vector<T> & values){
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be cached.");
+		write(uint64_t(values.size()));
+		writeBytes(values.data(), values.size() * sizeof(T));
+	}
+
+	void writeString(const std::string & str);
+
+	/// Write the content to disk, replacing any existing file only once complete.
+	bool save(const std::string & path) const;
+
+private:
+
+	std::vector<uint8_t> _data;
+};
+
+/// Read a binary cache produced by CacheWriter. All reads are bounds-checked and return false on failure.
+class CacheReader {
+public:
+
+	CacheReader(const ByteSpan & buffer) : _buffer(buffer) {}
+
+	bool readBytes(void * data, size_t size);
+
+	template<typename T>
+	bool read(T & value){
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be cached.");
+		return readBytes(&value, sizeof(T));
+	}
+
+	template<typename T>
+	bool readArray(std::vector<T> & values){
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be cached.");
+		uint64_t count = 0;
+		if(!read(count) || count > (_buffer.size - _position) / (std::max)(sizeof(T), size_t(1))){
+			return false;
+		}
+		values.resize(size_t(count));
+		return readBytes(values.data(), size_t(count) * sizeof(T));
+	}
+
+	bool readString(std::string & str);
+
+private:
+
+	ByteSpan _buffer;
+	size_t _position = 0;
+};
+
+#endif // MIDI_CACHE_H
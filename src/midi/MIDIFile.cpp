@@ -1,28 +1,97 @@
 #include <algorithm>
-#include <iterator>
-#include <fstream>
 
 #include "MIDIFile.h"
+#include "../helpers/MappedFile.h"
 #include "../helpers/System.h"
 
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+std::string MIDIFile::_cacheDirectory = "";
+bool MIDIFile::_keepEvents = false;
+
+// Identifies a cache and the layout of the stored data.
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t overlap;
+	uint64_t hash;
+	uint64_t fileSize;
+	uint32_t noteSize;
+	uint32_t pedalSize;
+	uint32_t tempoSize;
+	uint32_t tracksCount;
+};
+
+static const char kCacheMagic[8] = { 'M', 'I', 'D', 'I', 'V', 'I', 'Z', 'C' };
+
+// Duration of the time segments decoded at once when streaming.
+static const double kStreamSegmentDuration = 2.0;
+// Notes processed by each task when updating sets.
+static const size_t kSetsChunkSize = 1 << 16;
+// Measures beyond this count are extrapolated from the last ones.
+static const size_t kMaxMeasuresCount = 1 << 16;
+
+// Share of the loading spent on each step, for progress reporting.
+static const float kProgressRead = 0.2f;
+static const float kProgressExtract = 0.9f;
+
+// Update the loading progress if any, and stop if the loading was cancelled.
+static void reportProgress(LoadingProgress * progress, float value){
+	if(progress == nullptr){
+		return;
+	}
+	if(progress->cancelled){
+		throw "Cancelled";
+	}
+	progress->value = value;
+}
+
+// Peak count of notes held at once over all tracks, zero if their notes are not stored.
+// Notes of each track are already sorted by start, visit them in merged order while keeping the ends of held notes in a heap.
+static size_t computePolyphony(const std::vector<MIDITrack> & tracks){
+	std::vector<const std::vector<MIDINote>*> notes;
+	notes.reserve(tracks.size());
+	for(const auto & track : tracks){
+		if(track.streamed()){
+			return 0;
+		}
+		notes.push_back(&track.notes());
+	}
+	// Earliest end on top.
+	const auto later = [](uint32_t a, uint32_t b){ return a > b; };
+	std::vector<uint32_t> ends;
+	size_t peak = 0;
+	forEachSorted(notes, [](const MIDINote & note){ return note.startUnits; }, [&ends, &peak, &later](const MIDINote & note){
+		// Notes ending when another starts are not held together.
+		while(!ends.empty() && ends.front() <= note.startUnits){
+			std::pop_heap(ends.begin(), ends.end(), later);
+			ends.pop_back();
+		}
+		ends.push_back(note.endUnits);
+		std::push_heap(ends.begin(), ends.end(), later);
+		peak = (std::max)(peak, ends.size());
+	});
+	return peak;
+}
+
 MIDIFile::MIDIFile(){};
 
-MIDIFile::MIDIFile(const std::string & filePath){
-	std::ifstream input = System::openInputFile(filePath, true);
+MIDIFile::MIDIFile(const std::string & filePath, NoteOverlap overlap, bool streamed, LoadingProgress * progress){
+	// Map the file in memory, the parser will read directly from it.
+	// Streamed tracks keep reading from it during playback.
+	const std::shared_ptr<MappedFile> input(new MappedFile(filePath));
 
-	if(!input.is_open()) {
+	if(!input->isValid()) {
 		std::cerr << "[ERROR]: Couldn't find file at path " << filePath << std::endl;
 		throw "BadInput";
 	}
-	
-	std::vector<char> buffer;
-	std::copy(std::istreambuf_iterator<char>(input),
-			  std::istreambuf_iterator<char>(),
-			  std::back_inserter(buffer));
-	input.close();
+	const ByteSpan buffer(input->data(), input->size());
 
 	// Check midi header
-	if(buffer.size() < 5 || !(buffer[0] == 'M' && buffer[1] == 'T' && buffer[2] == 'h' && buffer[3] == 'd') || read32(buffer, 4) != 6){
+	if(buffer.size < 14 || !matchesTag(buffer, 0, "MThd") || read32(buffer, 4) != 6){
 		std::cerr << "[ERROR]: " << filePath << " is not a midi file." << std::endl;
 		throw "BadInput";
 	}
@@ -45,10 +114,42 @@ MIDIFile::MIDIFile(const std::string & filePath){
 		throw "BadInput";
 	}
 
+	// Start from a previously parsed version of the same file if possible.
+	// Streamed files are too large to be cached, and cached files have no events to print.
+	std::string cachePath;
+	CacheHeader cacheHeader = {};
+	if(!_cacheDirectory.empty() && !streamed && !_keepEvents){
+		std::memcpy(cacheHeader.magic, kCacheMagic, sizeof(kCacheMagic));
+		cacheHeader.version = MIDI_CACHE_VERSION;
+		cacheHeader.overlap = uint32_t(overlap);
+		cacheHeader.hash = hashBytes(buffer);
+		cacheHeader.fileSize = buffer.size;
+		cacheHeader.noteSize = uint32_t(sizeof(MIDINote));
+		cacheHeader.pedalSize = uint32_t(sizeof(MIDIPedal));
+		cacheHeader.tempoSize = uint32_t(sizeof(MIDITempo));
+		// Upper bound, fewer tracks are stored if some are missing or merged.
+		cacheHeader.tracksCount = tracksCount;
+
+		std::stringstream name;
+		name << std::hex << std::setfill('0') << std::setw(16) << cacheHeader.hash << "_" << cacheHeader.overlap << ".cache";
+		cachePath = _cacheDirectory + name.str();
+		if(loadCache(cachePath, cacheHeader)){
+			std::cout << "[INFO]: Loaded notes from cache " << cachePath << "." << std::endl;
+			reportProgress(progress, kProgressExtract);
+			prepareForPlayback();
+			return;
+		}
+	}
+
 	bool shouldMerge = false;
 	if(_format == singleTrack && tracksCount > 1){
-		std::cerr << "[WARNING]: " << "Too many tracks, will merge all tracks." << std::endl;
-		shouldMerge = true;
+		// Notes of streamed tracks are never all in memory.
+		if(streamed){
+			std::cerr << "[WARNING]: " << "Too many tracks, will keep them separate." << std::endl;
+		} else {
+			std::cerr << "[WARNING]: " << "Too many tracks, will merge all tracks." << std::endl;
+			shouldMerge = true;
+		}
 	}
 
 	// Division mode.
@@ -74,52 +175,216 @@ MIDIFile::MIDIFile(const std::string & filePath){
 		_framesPerSeconds = 0.0f;
 	}
 
-	// Parse tracks.
+	// Locate all track chunks first, their lengths are given in their headers.
+	std::vector<ByteSpan> chunks;
 	size_t pos = 14;
-	for(size_t trackId = 0; trackId < tracksCount; ++trackId){
-		std::cout << "[INFO]: " << "Reading track " << trackId << "." << std::endl;
-		_tracks.emplace_back();
-		pos = _tracks.back().readTrack(buffer, pos);
+	while(chunks.size() < tracksCount && pos + 8 <= buffer.size){
+		const bool isTrack = matchesTag(buffer, pos, "MTrk");
+		const uint32_t length = read32(buffer, pos + 4);
+		pos += 8;
+		if(isTrack){
+			if(pos + length > buffer.size){
+				std::cerr << "[WARNING]: " << "Truncated track " << chunks.size() << "." << std::endl;
+			}
+			chunks.push_back(buffer.subspan(pos, length));
+		} else {
+			// Skip unknown chunks.
+			std::cerr << "[WARNING]: " << "Skipping unknown chunk." << std::endl;
+		}
+		pos += length;
+	}
+	if(chunks.size() < tracksCount){
+		std::cerr << "[ERROR]: Missing track." << std::endl;
+		if(chunks.empty()){
+			throw "BadInput";
+		}
+	}
+
+	// Parse tracks independently.
+	_tracks.resize(chunks.size());
+	const float tracksCountF = float(chunks.size());
+	std::atomic<size_t> tracksDone(0);
+	System::forParallel(0, chunks.size(), [this, &chunks, streamed, progress, &tracksDone, tracksCountF](size_t trackId){
+		reportProgress(progress, kProgressRead * float(tracksDone) / tracksCountF);
+		if(streamed){
+			_tracks[trackId].streamTrack(chunks[trackId], kStreamSegmentDuration);
+		} else {
+			_tracks[trackId].readTrack(chunks[trackId], _keepEvents);
+		}
+		++tracksDone;
+	});
+	reportProgress(progress, kProgressRead);
+	for(size_t trackId = 0; trackId < _tracks.size(); ++trackId){
+		std::cout << "[INFO]: " << "Read track " << trackId << "." << std::endl;
+		_tracks[trackId].printInfos();
+	}
+
+	// Report events storage.
+	if(_keepEvents && !streamed){
+		size_t eventsCount = 0;
+		size_t packedSize = 0;
+		size_t unpackedSize = 0;
+		for(const auto & track : _tracks){
+			eventsCount += track.events().size();
+			packedSize += track.events().memorySize();
+			unpackedSize += track.events().unpackedMemorySize();
+		}
+		const double toMB = 1.0 / (1024.0 * 1024.0);
+		std::cout << "[INFO]: " << eventsCount << " events stored in " << (double(packedSize) * toMB) << "MB";
+		std::cout << " (saved " << (double(unpackedSize - (std::min)(unpackedSize, packedSize)) * toMB) << "MB)." << std::endl;
 	}
 
 	// Extract tempos and the signature.
 	populateTemposAndSignature();
 
 	// Update seconds per measure.
-	_secondsPerMeasure = computeMeasureDuration(_tempos[0].tempo, _signature);
+	_secondsPerMeasure = computeMeasureDuration(_tempos.tempos()[0].tempo, _signature);
 
 	// Convert each track to real notes.
-	for(size_t tid = 0; tid < _tracks.size(); ++tid){
-		auto & track = _tracks[tid];
-		track.extractNotes(_tempos, _unitsPerQuarterNote, (unsigned int)tid);
-	}
+	tracksDone = 0;
+	System::forParallel(0, _tracks.size(), [this, overlap, progress, &tracksDone, tracksCountF](size_t tid){
+		reportProgress(progress, kProgressRead + (kProgressExtract - kProgressRead) * float(tracksDone) / tracksCountF);
+		_tracks[tid].extractNotes(_tempos, (unsigned int)tid, overlap);
+		++tracksDone;
+	});
+	reportProgress(progress, kProgressExtract);
 
-	// For now, still merge.
-	shouldMerge = true;
 	if(shouldMerge){
 		mergeTracks();
 	}
 
-	// Normalize pedal values.
+	// Pedals apply to the whole file, gather them from all tracks.
+	populatePedals();
+
+	if(!cachePath.empty()){
+		if(saveCache(cachePath, cacheHeader)){
+			std::cout << "[INFO]: Saved notes to cache " << cachePath << "." << std::endl;
+		} else {
+			std::cerr << "[WARNING]: Unable to save cache to " << cachePath << "." << std::endl;
+		}
+	}
+
+	reportProgress(progress, kProgressExtract);
+	prepareForPlayback();
+
+	if(streamed){
+		_stream.reset(new NotesStream(input, _tracks, _tempos, overlap, kStreamSegmentDuration, _duration));
+		std::cout << "[INFO]: Notes will be decoded during playback, in segments of " << kStreamSegmentDuration << "s." << std::endl;
+	}
+}
+
+void MIDIFile::prepareForPlayback(){
+	// Index notes of each track.
 	for(auto & track : _tracks){
-		track.normalizePedalVelocity();
+		track.indexNotes(_tempos);
+	}
+
+	// Build pedal timelines.
+	const std::array<PedalType, 4> types = { DAMPER, SOSTENUTO, SOFT, EXPRESSION };
+	for(size_t pid = 0; pid < types.size(); ++pid){
+		_pedalTimelines[pid].build(_pedals, types[pid]);
+		_pedalCursors[pid] = PedalTimeline::Cursor();
 	}
 
-	// Compute duration.
+	// Gather statistics computed during extraction.
+	_statistics = MIDIStatistics();
 	for(const auto & track : _tracks){
-		std::vector<MIDINote> notes;
-		track.getNotes(notes, NoteType::ALL);
-		for(const auto & note : notes){
-			_duration = (std::max)(_duration, note.start + note.duration);
+		_statistics.merge(track.statistics());
+	}
+	_statistics.maxPolyphony = computePolyphony(_tracks);
+	_statistics.print();
+	_duration = _statistics.duration;
+	_count = int(_statistics.notesCount);
+
+	// Measures have a fixed length in units, their duration follows tempo changes.
+	_measureStarts.clear();
+	const double measureUnits = 4.0 * _signature * double(_unitsPerQuarterNote);
+	if(measureUnits >= 1.0){
+		TempoMap::Cursor cursor;
+		for(size_t mid = 0; mid < kMaxMeasuresCount; ++mid){
+			_measureStarts.push_back(_tempos.secondsAt(size_t(std::round(double(mid) * measureUnits)), cursor));
+			if(_measureStarts.back() > _duration){
+				break;
+			}
 		}
-		_count += int(notes.size());
 	}
 }
 
+void MIDIFile::setCacheDirectory(const std::string & directory){
+	_cacheDirectory = directory;
+}
+
+void MIDIFile::setKeepEvents(bool keepEvents){
+	_keepEvents = keepEvents;
+}
+
+bool MIDIFile::saveCache(const std::string & path, const CacheHeader & header) const {
+	CacheWriter writer;
+	CacheHeader fullHeader = header;
+	fullHeader.tracksCount = uint32_t(_tracks.size());
+	writer.write(fullHeader);
+	writer.write(uint32_t(_format));
+	writer.write(uint32_t(_unitsPerFrame));
+	writer.write(_framesPerSeconds);
+	writer.write(uint32_t(_unitsPerQuarterNote));
+	writer.write(_signature);
+	writer.write(_secondsPerMeasure);
+	writer.writeArray(_tempos.tempos());
+	writer.writeArray(_pedals);
+	for(const auto & track : _tracks){
+		track.writeCache(writer);
+	}
+	return writer.save(path);
+}
+
+bool MIDIFile::loadCache(const std::string & path, const CacheHeader & header){
+	const MappedFile input(path);
+	if(!input.isValid()){
+		return false;
+	}
+	CacheReader reader(ByteSpan(input.data(), input.size()));
+	CacheHeader storedHeader;
+	if(!reader.read(storedHeader)){
+		return false;
+	}
+	// Everything but the tracks count should match, it can't exceed the one in the file header.
+	CacheHeader expectedHeader = header;
+	expectedHeader.tracksCount = storedHeader.tracksCount;
+	if(std::memcmp(&storedHeader, &expectedHeader, sizeof(CacheHeader)) != 0){
+		std::cout << "[INFO]: Outdated cache " << path << ", ignoring it." << std::endl;
+		return false;
+	}
+
+	uint32_t format = 0;
+	uint32_t unitsPerFrame = 0;
+	uint32_t unitsPerQuarterNote = 0;
+	std::vector<MIDITempo> tempos;
+	bool success = reader.read(format) && reader.read(unitsPerFrame) && reader.read(_framesPerSeconds)
+		&& reader.read(unitsPerQuarterNote) && reader.read(_signature) && reader.read(_secondsPerMeasure)
+		&& reader.readArray(tempos) && reader.readArray(_pedals)
+		&& storedHeader.tracksCount > 0 && storedHeader.tracksCount <= header.tracksCount;
+	_tracks.resize(success ? storedHeader.tracksCount : 0);
+	for(size_t tid = 0; success && tid < _tracks.size(); ++tid){
+		success = _tracks[tid].readCache(reader);
+	}
+	if(!success || tempos.empty()){
+		std::cerr << "[WARNING]: Corrupted cache " << path << ", ignoring it." << std::endl;
+		_tracks.clear();
+		_pedals.clear();
+		return false;
+	}
+	_format = MIDIType(format);
+	_unitsPerFrame = uint16_t(unitsPerFrame);
+	_unitsPerQuarterNote = uint16_t(unitsPerQuarterNote);
+	_tempos = TempoMap(tempos, _unitsPerQuarterNote);
+	return true;
+}
+
 void MIDIFile::print() const {
-	for(size_t tid = 0; tid < _tracks.size(); ++tid){
+	const std::vector<MIDITrack> & allTracks = tracks();
+	for(size_t tid = 0; tid < allTracks.size(); ++tid){
 		std::cout << "[INFO]: ---- Track " << tid << std::endl;
-		_tracks[tid].print();
+		allTracks[tid].print();
 	}
 }
 
@@ -142,56 +407,147 @@ void MIDIFile::populateTemposAndSignature(){
 	for(const auto & tempo : mixedTempos){
 		tempoChanges[tempo.start] = tempo;
 	}
+	std::vector<MIDITempo> tempos;
+	tempos.reserve(tempoChanges.size());
 	for(const auto & tempo : tempoChanges){
-		_tempos.push_back(tempo.second);
+		tempos.push_back(tempo.second);
 	}
-	std::sort(_tempos.begin(), _tempos.end(), [](const MIDITempo& a, const MIDITempo& b){
+	std::sort(tempos.begin(), tempos.end(), [](const MIDITempo& a, const MIDITempo& b){
 		return a.start < b.start;
 	});
-
-	// Compute the real time stamp of each tempo.
-	// We are guaranteed that there is an event at t = 0.
-	double currentTime = 0.0;
-	_tempos[0].timestamp = 0.0;
-	for(size_t tid = 1; tid < _tempos.size(); ++tid){
-		const int delta = int(_tempos[tid].start) - int(_tempos[tid-1].start);
-		currentTime += computeUnitsDuration(_tempos[tid-1].tempo, delta, _unitsPerQuarterNote);
-		_tempos[tid].timestamp = currentTime;
-	}
+	// Precompute the real time stamp of each tempo.
+	_tempos = TempoMap(tempos, _unitsPerQuarterNote);
 }
 
 void MIDIFile::mergeTracks(){
 	
-	for(size_t i = 1; i < _tracks.size(); ++i){
-		_tracks[0].merge(_tracks[i]);
-	}
+	_tracks[0].merge(_tracks);
 	_tracks.resize(1);
 	
 }
 
-void MIDIFile::getNotes(std::vector<MIDINote> & notes, NoteType type, size_t track) const {
-	if(track >= _tracks.size()){
-		return;
+void MIDIFile::populatePedals(){
+	std::vector<const std::vector<MIDIPedal>*> pedals;
+	for(const auto & track : _tracks){
+		pedals.push_back(&track.pedals());
+	}
+	mergeSortedByStart(pedals, _pedals);
+
+	// Normalize values, for now only wrt the upper bound.
+	if(!_pedals.empty()){
+		float maxV = _pedals[0].velocity;
+		float minV = 0.0f;
+		for(size_t pid = 1; pid < _pedals.size(); ++pid){
+			maxV = (std::max)(maxV, _pedals[pid].velocity);
+		}
+		// Renormalize in 0,1.
+		const float denom = 1.0f / (maxV - minV);
+		for(auto & pedal : _pedals){
+			pedal.velocity = (pedal.velocity - minV) * denom;
+		}
 	}
-	_tracks[track].getNotes(notes, type);
 }
 
-void MIDIFile::getNotesActive(ActiveNotesArray & actives, double time, size_t track) const {
-	if(track >= _tracks.size()){
+void MIDIFile::getNotesActive(ActiveNotesArray & actives, double time, size_t track) {
+	if(track >= tracksCount()){
 		return;
 	}
-	_tracks[track].getNotesActive(actives, time);
+	if(_stream){
+		_stream->getNotesActive(actives, time, track);
+		return;
+	}
+	_tracks[track].getNotesActive(actives, time, _tempos);
 }
 
-void MIDIFile::getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double time, size_t track) const {
-	if(track >= _tracks.size()){
-		return;
+void MIDIFile::getNotesActive(ActiveNotesArray & actives, double time, const std::vector<bool> & enabledTracks, const std::vector<int> & tracksSets) {
+	// Reset all notes.
+	for(int i = 0; i < int(actives.size()); ++i){
+		 actives[i].enabled = false;
+	}
+	ActiveNotesArray trackActives;
+	const size_t count = (std::min)(tracksCount(), enabledTracks.size());
+	for(size_t tid = 0; tid < count; ++tid){
+		if(!enabledTracks[tid]){
+			continue;
+		}
+		getNotesActive(trackActives, time, tid);
+		// Notes of the track can all use the same set.
+		if(tid < tracksSets.size() && tracksSets[tid] >= 0){
+			for(auto & trackNote : trackActives){
+				trackNote.set = tracksSets[tid];
+			}
+		}
+		// As if tracks were merged: keep the latest note on each key, then the one in the last track.
+		for(size_t key = 0; key < actives.size(); ++key){
+			const auto & trackNote = trackActives[key];
+			if(trackNote.enabled && (!actives[key].enabled || trackNote.start >= actives[key].start)){
+				actives[key] = trackNote;
+			}
+		}
 	}
-	_tracks[track].getPedalsActive(damper, sostenuto, soft, expression, time);
+}
+
+void MIDIFile::getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double time) {
+	// Timelines are in the same order as in populatePedals.
+	damper = _pedalTimelines[0].valueAt(time, _pedalCursors[0]);
+	sostenuto = _pedalTimelines[1].valueAt(time, _pedalCursors[1]);
+	soft = _pedalTimelines[2].valueAt(time, _pedalCursors[2]);
+	expression = _pedalTimelines[3].valueAt(time, _pedalCursors[3]);
+}
+
+bool MIDIFile::setWindow(double start, double end){
+	return _stream ? _stream->setWindow(start, end) : false;
+}
+
+const std::string & MIDIFile::trackName(size_t track) const {
+	return tracks()[track].name();
 }
 
 void MIDIFile::updateSets(const SetOptions & options){
-	for(auto & track : _tracks){
-		track.updateSets(options);
+	std::vector<std::vector<SetsChange>> changes;
+	updateSets(options, changes);
+}
+
+void MIDIFile::updateSets(const SetOptions & options, std::vector<std::vector<SetsChange>> & changes){
+	changes.clear();
+	changes.resize(tracksCount());
+	if(_stream){
+		_stream->updateSets(options);
+		return;
+	}
+	// Split tracks in chunks of notes, updated in parallel.
+	struct Chunk {
+		size_t track;
+		size_t first;
+		size_t last;
+		size_t minorCount;
+		std::vector<SetsChange> changes;
+	};
+	std::vector<Chunk> chunks;
+	for(size_t tid = 0; tid < _tracks.size(); ++tid){
+		const size_t count = _tracks[tid].notesCount();
+		for(size_t first = 0; first < count; first += kSetsChunkSize){
+			chunks.push_back({ tid, first, (std::min)(first + kSetsChunkSize, count), 0, {} });
+		}
+	}
+	System::forParallel(0, chunks.size(), [this, &chunks, &options](size_t cid){
+		Chunk & chunk = chunks[cid];
+		chunk.minorCount = _tracks[chunk.track].updateSets(options, _tempos, chunk.first, chunk.last, chunk.changes);
+	});
+	// Locate changes among notes of the same type in the whole track.
+	size_t majorOffset = 0;
+	size_t minorOffset = 0;
+	for(size_t cid = 0; cid < chunks.size(); ++cid){
+		const Chunk & chunk = chunks[cid];
+		if(cid == 0 || chunks[cid - 1].track != chunk.track){
+			majorOffset = minorOffset = 0;
+		}
+		for(const SetsChange & change : chunk.changes){
+			changes[chunk.track].push_back(change);
+			changes[chunk.track].back().firstMajor += majorOffset;
+			changes[chunk.track].back().firstMinor += minorOffset;
+		}
+		majorOffset += (chunk.last - chunk.first) - chunk.minorCount;
+		minorOffset += chunk.minorCount;
 	}
 }
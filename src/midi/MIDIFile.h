@@ -4,6 +4,23 @@
 #include "MIDIUtils.h"
 #include "MIDIBase.h"
 #include "MIDITrack.h"
+#include "TempoMap.h"
+#include "PedalTimeline.h"
+#include "MIDICache.h"
+#include "NotesStream.h"
+
+#include <memory>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+struct CacheHeader;
+
+/// Shared with a thread loading a file, to follow its progress and interrupt it.
+struct LoadingProgress {
+	std::atomic<float> value{0.0f}; ///< Between 0 and 1.
+	std::atomic<bool> cancelled{false}; ///< The loading stops at the next check, throwing "Cancelled".
+};
 
 class MIDIFile {
 
@@ -11,43 +28,115 @@ public:
 	
 	MIDIFile();
 	
-	MIDIFile(const std::string & filePath);
+	/// If streamed, notes are decoded on demand in a window around the current time, see setWindow.
+	/// Progress is reported if provided, and checked for cancellation between steps.
+	MIDIFile(const std::string & filePath, NoteOverlap overlap, bool streamed, LoadingProgress * progress = nullptr);
 
 	void updateSets(const SetOptions & options);
 
+	/// Reassign sets in parallel, collecting for each track the notes whose set changed.
+	/// Nothing is collected for streamed files, their notes are updated when requested again.
+	void updateSets(const SetOptions & options, std::vector<std::vector<SetsChange>> & changes);
+
 	void print() const;
 
-	void getNotes(std::vector<MIDINote>& notes, NoteType type, size_t track) const;
+	/// Call a function on each note of a track sorted by start, with its original key, without copying notes.
+	/// For streamed files, only the notes in the window are visited.
+	template<typename Visitor>
+	void forEachNote(size_t track, Visitor visitor) const {
+		if(_stream){
+			_stream->forEachNote(track, visitor);
+			return;
+		}
+		forEachNote(track, 0, std::numeric_limits<size_t>::max(), visitor);
+	}
+
+	/// Same for the notes [first, last) of a track, not for streamed files.
+	template<typename Visitor>
+	void forEachNote(size_t track, size_t first, size_t last, Visitor visitor) const {
+		if(_stream || track >= _tracks.size()){
+			return;
+		}
+		const std::vector<MIDINote> & notes = _tracks[track].notes();
+		last = (std::min)(last, notes.size());
+		for(size_t nid = first; nid < last; ++nid){
+			visitor(notes[nid]);
+		}
+	}
 	
-	void getNotesActive(ActiveNotesArray& actives, double time, size_t track) const;
+	void getNotesActive(ActiveNotesArray& actives, double time, size_t track);
+
+	void getNotesActive(ActiveNotesArray& actives, double time, const std::vector<bool> & enabledTracks, const std::vector<int> & tracksSets);
+
+	void getPedalsActive(float &damper, float &sostenuto, float &soft, float &expression, double time);
+
+	/// For streamed files, select the time range where notes should be available, see NotesStream::setWindow.
+	/// \return true if the notes in the window changed, and should be gathered again by MIDISceneFile::buildNotes
+	bool setWindow(double start, double end);
+
+	bool streamed() const { return bool(_stream); }
+
+	size_t tracksCount() const { return tracks().size(); }
+
+	const std::string & trackName(size_t track) const;
+
+	/// Store parsed files in this directory, and load them from it when possible. Disabled if empty.
+	static void setCacheDirectory(const std::string & directory);
 
-	void getPedalsActive(float &damper, float &sostenuto, float &soft, float &expression, double time, size_t track) const;
+	/// Keep all events of loaded files in memory, to print them. Only useful for debugging.
+	static void setKeepEvents(bool keepEvents);
 
 	const double & signature() const { return _signature; }
 	
 	const double & secondsPerMeasure() const { return _secondsPerMeasure; }
 
+	/// Start of each measure until the end of the file, following tempo changes.
+	const std::vector<double> & measureStarts() const { return _measureStarts; }
+
 	const double & duration() const { return _duration; }
 
 	const int & notesCount() const { return _count; }
 
+	const MIDIStatistics & statistics() const { return _statistics; }
+
+	const TempoMap & tempos() const { return _tempos; }
+
 private:
 
 	void populateTemposAndSignature();
 
 	void mergeTracks();
 
+	void populatePedals();
+
+	void prepareForPlayback();
+
+	const std::vector<MIDITrack> & tracks() const { return _stream ? _stream->tracks() : _tracks; }
+
+	bool saveCache(const std::string & path, const CacheHeader & header) const;
+
+	bool loadCache(const std::string & path, const CacheHeader & header);
+
 	MIDIType _format = MIDIType::singleTrack;
 	uint16_t _unitsPerFrame = 1;
 	float _framesPerSeconds = 1;
 	uint16_t _unitsPerQuarterNote = 1;
 	double _signature = 4.0/4.0;
 	double _secondsPerMeasure = 1.0;
+	std::vector<double> _measureStarts;
 	double _duration = 0.0;
 	int _count = 0;
 
 	std::vector<MIDITrack> _tracks;
-	std::vector<MIDITempo> _tempos;
+	TempoMap _tempos;
+	MIDIStatistics _statistics;
+	std::vector<MIDIPedal> _pedals;
+	std::array<PedalTimeline, 4> _pedalTimelines;
+	std::array<PedalTimeline::Cursor, 4> _pedalCursors;
+	std::unique_ptr<NotesStream> _stream; ///< Owns the tracks if streamed.
+
+	static std::string _cacheDirectory;
+	static bool _keepEvents;
 
 };
 
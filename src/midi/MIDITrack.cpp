@@ -1,268 +1,402 @@
 #include "MIDITrack.h"
 
-#include <tuple>
 #include <cmath>
 #include <algorithm>
 #include "../rendering/SetOptions.h"
 
-// We will have to keep track of active notes per-channel.
-struct NoteKey {
-	short index;
-	short channel;
+// Changed notes separated by at most this many notes are reported as one span.
+static const size_t kSetsChangeGap = 256;
+
+// Event time, both in units and converted to seconds.
+struct EventTime {
+	size_t units;
+	double seconds;
+};
+
+// Notes held on a given key and channel, oldest first.
+struct HeldNotes {
+	static const uint8_t capacity = 8;
+
+	EventTime starts[capacity];
+	short velocities[capacity];
+	uint8_t first = 0;
+	uint8_t count = 0;
+
+	void push(const EventTime & start, short velocity){
+		const uint8_t slot = (first + count) % capacity;
+		starts[slot] = start;
+		velocities[slot] = velocity;
+		++count;
+	}
+
+	uint8_t popOldest(){
+		const uint8_t slot = first;
+		first = (first + 1) % capacity;
+		--count;
+		return slot;
+	}
+
+	uint8_t popNewest(){
+		--count;
+		return (first + count) % capacity;
+	}
+};
+
+// Pedal held for a given controller.
+struct HeldPedal {
+	double start = 0.0;
+	short velocity = 0;
+	bool held = false;
 };
 
-bool operator==(const NoteKey& a, const NoteKey& b){
-	return (a.index == b.index) && (a.channel == b.channel);
+// Only a few controllers are interpreted as pedals.
+static int pedalIndex(int controller){
+	switch(controller){
+		case PedalType::DAMPER:
+			return 0;
+		case PedalType::SOSTENUTO:
+			return 1;
+		case PedalType::SOFT:
+			return 2;
+		case PedalType::EXPRESSION:
+			return 3;
+		default:
+			break;
+	}
+	return -1;
 }
 
-namespace std {
-	template<> struct hash<NoteKey> {
-		std::size_t operator()(const NoteKey& n) const noexcept {
-			return ((n.index & 0xFFFF) << 16) | ( n.channel & 0xFFFF);
+// Pair press and release events into notes and pedals, following an overlap policy.
+class EventPairing {
+public:
+
+	EventPairing(NoteOverlap overlap) : _heldNotes(16 * 128), _overlap(overlap) {}
+
+	// Register a note event, return true if it finishes a note, with its start and velocity.
+	bool note(short key, short channel, short velocity, bool isPress, const EventTime & time, EventTime & start, short & startVelocity){
+		HeldNotes & held = _heldNotes[channel * 128 + key];
+		// Decide which held note to finish, if any.
+		int slot = -1;
+		if(held.count > 0){
+			if(_overlap == NoteOverlap::RETRIGGER || (isPress && held.count == HeldNotes::capacity)){
+				// Either any event ends the held note, or there is no more room.
+				slot = held.popOldest();
+			} else if(!isPress){
+				slot = _overlap == NoteOverlap::FIFO ? held.popOldest() : held.popNewest();
+			}
 		}
-	};
-}
+		if(slot >= 0){
+			start = held.starts[slot];
+			startVelocity = held.velocities[slot];
+			--_heldCount;
+		}
+		// Check if we have to start a new note.
+		if(isPress){
+			hold(uint16_t(channel * 128 + key), time, velocity);
+		}
+		return slot >= 0;
+	}
 
-size_t MIDITrack::readTrack(const std::vector<char>& buffer, size_t pos){
-	const size_t backupPos = pos;
-	
-	//Check header
-	if( !(buffer[pos] == 'M' && buffer[pos+1] == 'T' && buffer[pos+2] == 'r' && buffer[pos+3] == 'k')){
-		std::cerr << "[ERROR]: Missing track." << std::endl;
-		return 3;
+	// Register a pedal event, return true if it finishes a press, with its start and velocity.
+	bool pedal(int pedalId, short value, double time, double & start, short & startVelocity){
+		HeldPedal & held = _heldPedals[pedalId];
+		const bool finished = held.held;
+		if(finished){
+			start = held.start;
+			startVelocity = held.velocity;
+			held.held = false;
+		}
+		// Check if we have to start a new press.
+		if(value > 0){
+			held.start = time;
+			held.velocity = value;
+			held.held = true;
+		}
+		return finished;
 	}
-	pos += 4;
-	uint32_t length = read32(buffer, pos);
-	pos += 4;
-	
-	if(length == 0){
-		std::cerr << "[ERROR]: Empty track." << std::endl;
-		return 3;
+
+	void hold(uint16_t slot, const EventTime & start, short velocity){
+		HeldNotes & held = _heldNotes[slot];
+		if(held.count == 0){
+			_usedSlots.push_back(slot);
+		}
+		held.push(start, velocity);
+		++_heldCount;
 	}
 
-	while(pos < backupPos + 8 + length){
-		
-		size_t delta = readVarLen(buffer,pos);
-		uint8_t eventMetaType = read8(buffer, pos);
-		
-		if(eventMetaType == 0xFF){
-			_events.push_back(MIDIEvent::readMetaEvent(buffer,pos, delta));
-		} else if (eventMetaType >= 0xF0 && eventMetaType <= 0xF7){
-			_events.push_back(MIDIEvent::readSysexEvent(buffer, pos, delta));
-		}  else {
-			_events.push_back(MIDIEvent::readMIDIEvent(buffer, pos, delta, _previousEventFirstByte));
+	// Release all held notes and pedals, only visiting the keys used since the last reset.
+	void reset(NoteOverlap overlap){
+		for(const uint16_t slot : _usedSlots){
+			_heldNotes[slot].first = 0;
+			_heldNotes[slot].count = 0;
 		}
+		_usedSlots.clear();
+		_heldPedals = {};
+		_overlap = overlap;
+		_heldCount = 0;
 	}
 
-	// Scan events for track info.
-	// Could do it while creating events, but let's separate tasks, shall we?
-	bool minorKey = false;
-	short keyShift = 0;
-
-	for(auto& event : _events){
-		if(event.category == EventCategory::META){
-			if(event.type == sequenceName){
-				std::string tempName = "";
-				for(size_t i = 0; i < event.data.size(); ++i){
-					tempName += char(event.data[i]);
-				}
-				_name = tempName;
-			} else if(event.type == instrumentName){
-				std::string tempName = "";
-				for(size_t i = 0; i < event.data.size(); ++i){
-					tempName += char(event.data[i]);
-				}
-				_instrument = tempName;
-			} else if (event.type == keySignature){
-				// Should be in -7,7
-				keyShift = event.data[0];
-				minorKey = (event.data[1] > 0);
+	// Call a function on each held note, oldest first for each key.
+	template<typename F>
+	void forEachHeld(F func) const {
+		if(_heldCount == 0){
+			return;
+		}
+		for(size_t sid = 0; sid < _heldNotes.size(); ++sid){
+			const HeldNotes & held = _heldNotes[sid];
+			for(uint8_t hid = 0; hid < held.count; ++hid){
+				const uint8_t slot = (held.first + hid) % HeldNotes::capacity;
+				func(uint16_t(sid), held.starts[slot], held.velocities[slot]);
 			}
 		}
 	}
-	
-	std::cout << "[INFO]: Track " << _name << " (length: " << length << ", instrument: " << _instrument <<", " << (minorKey ? "minor": "major") << ")." << std::endl;
-	
-	return backupPos + 8 + length;
+
+	size_t heldCount() const { return _heldCount; }
+
+private:
+
+	std::vector<HeldNotes> _heldNotes;
+	std::vector<uint16_t> _usedSlots; ///< Keys that held notes since the last reset, some might be listed twice.
+	std::array<HeldPedal, 4> _heldPedals;
+	NoteOverlap _overlap;
+	size_t _heldCount = 0;
+};
+
+void MIDITrack::readTrack(const ByteSpan& buffer, bool keepEvents){
+	// The buffer contains the track events, without the chunk header.
+	// Notes will be decoded from it directly.
+	_length = buffer.size;
+	_chunk = buffer;
+	if(keepEvents){
+		// Most events in large files are 3 or 4 bytes long with running status.
+		_events.reserve(buffer.size / 4);
+		MIDIEventReader reader(buffer);
+		MIDIEvent event;
+		while(reader.next(event)){
+			_events.push(event);
+		}
+	}
+	readMetaEvents();
 }
 
-double MIDITrack::extractTempos(std::vector<MIDITempo> & tempos) const {
+void MIDITrack::streamTrack(const ByteSpan& buffer, double segmentDuration){
+	_length = buffer.size;
+	_chunk = buffer;
+	_segmentDuration = segmentDuration;
+	readMetaEvents();
+}
+
+void MIDITrack::readMetaEvents(){
+	// Track infos, tempos and the signature only depend on meta events.
+	_tempos.clear();
+	_signature = 4.0/4.0;
 	size_t timeInUnits = 0;
-	double signature = 4.0/4.0;
-	for(auto& event : _events){
+	MIDIEventReader reader(_chunk);
+	MIDIEvent event;
+	while(reader.nextMeta(event)){
 		timeInUnits += (event.delta);
-		if(event.category == EventCategory::META && event.type == setTempo){
+		if(event.type == sequenceName){
+			_name = std::string(reinterpret_cast<const char*>(event.data), event.size);
+		} else if(event.type == instrumentName){
+			_instrument = std::string(reinterpret_cast<const char*>(event.data), event.size);
+		} else if (event.type == keySignature && event.size >= 2){
+			// Should be in -7,7 for the first byte.
+			_minorKey = (event.data[1] > 0);
+		} else if(event.type == setTempo && event.size >= 3){
 			const unsigned int tempo = ((event.data[0] & 0xFF) << 16) | ((event.data[1] & 0xFF) << 8) | (event.data[2] & 0xFF);
-			tempos.emplace_back(timeInUnits, tempo);
-
-		} else if(event.category == EventCategory::META && event.type == timeSignature){
-			signature = double(event.data[0]) / double(std::pow(2,event.data[1]));
-
+			_tempos.emplace_back(timeInUnits, tempo);
+		} else if(event.type == timeSignature && event.size >= 2){
+			_signature = double(event.data[0]) / double(std::pow(2,event.data[1]));
 		}
 	}
-	return signature;
 }
 
-void MIDITrack::extractNotes(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote, unsigned int trackId){
+void MIDITrack::printInfos() const {
+	std::cout << "[INFO]: Track " << _name << " (length: " << _length << ", instrument: " << _instrument <<", " << (_minorKey ? "minor": "major") << ")." << std::endl;
+}
+
+double MIDITrack::extractTempos(std::vector<MIDITempo> & tempos) const {
+	tempos.insert(tempos.end(), _tempos.begin(), _tempos.end());
+	return _signature;
+}
+
+void MIDITrack::extractNotes(const TempoMap & tempos, unsigned int trackId, NoteOverlap overlap){
 	// Scan events, focusing on the note ON/OFF events.
-	// Keep track of active notes for each channel.
-	std::unordered_map<NoteKey, std::tuple<size_t, short, short>> currentNotes;
-	std::unordered_map<PedalType, std::tuple<size_t, short>> currentPedals;
+	// Keep track of held notes for each key of each channel, and held pedals.
+	EventPairing pairing(overlap);
 
 	size_t timeInUnits = 0;
-
-	for(auto& event : _events){
+	// Events are sorted, the tempo lookup can resume from the previous one.
+	TempoMap::Cursor tempoCursor;
+	_statistics = MIDIStatistics();
+	_segments.clear();
+	_segmentsHeld.clear();
+
+	// Positions in the track bytes are used to record segment starts of streamed tracks.
+	auto processEvent = [&](const MIDIEvent & event, size_t position, size_t nextPosition, uint8_t previousFirstByte){
+		const size_t previousUnits = timeInUnits;
 		timeInUnits += (event.delta);
 		if(event.category != EventCategory::MIDI){
-			continue;
+			return;
 		}
-
-		// Handle notes.
-		if(event.type == noteOn || event.type == noteOff){
-			// Ensure the ID is in 0-127.
-			const short noteInd = clamp<short>(event.data[1], 0, 127);
-			const short velocity = clamp<short>(event.data[2], 0, 127);
-			const short channel = event.data[0];
-
-			const NoteKey newNote = {noteInd, channel};
-			if(currentNotes.count(newNote) > 0){
-				// The current note is already present.
-				const auto & noteTuple = currentNotes[newNote];
-				// Finish it.
-				const size_t start = std::get<0>(noteTuple);
-				const size_t end = timeInUnits;
-				// Create the final note with timing.
-				// Look for the start and end timestamps using the tempos and their timestamps.
-				const auto times = computeNoteTimings(tempos, start, end, unitsPerQuarterNote);
-
-				const short velocity = std::get<1>(noteTuple);
-				const short channel = std::get<2>(noteTuple);
-				_notes.emplace_back(noteInd, times.first, times.second - times.first, velocity, channel, trackId);
-
-				// Remove note.
-				currentNotes.erase(newNote);
+		const bool isNote = event.type == noteOn || event.type == noteOff;
+		const int pedalId = event.type == controllerChange ? pedalIndex(clamp<int>(event.note, 0, 127)) : -1;
+		// Handle only notes and pedal changes.
+		if(!isNote && pedalId < 0){
+			return;
+		}
+		const double time = tempos.secondsAt(timeInUnits, tempoCursor);
+
+		if(streamed()){
+			// Record the state before this event for each segment starting since the previous one.
+			const size_t segment = segmentIndex(time, _segmentDuration);
+			while(_segments.size() <= segment){
+				SegmentStart segmentStart;
+				segmentStart.position = position;
+				segmentStart.units = previousUnits;
+				segmentStart.endPosition = position;
+				segmentStart.firstHeld = uint32_t(_segmentsHeld.size());
+				segmentStart.heldCount = uint32_t(pairing.heldCount());
+				segmentStart.previousFirstByte = previousFirstByte;
+				pairing.forEachHeld([this](uint16_t slot, const EventTime & start, short velocity){
+					_segmentsHeld.push_back({ start.units, velocity, slot });
+				});
+				_segments.push_back(segmentStart);
 			}
+		}
 
-			// Check if we have to start a new note.
-			const bool shouldNew = event.type == noteOn && velocity > 0;
-			if(shouldNew){
-				currentNotes[newNote] = std::make_tuple(timeInUnits, velocity, channel);
-			}
-		} else if(event.type == controllerChange){
-			const int rawType = clamp<int>(event.data[1], 0, 127);
-			// Handle only pedal changes.
-			if(rawType != 64 && rawType != 66 && rawType != 67 && rawType != 11){
-				continue;
-			}
-			const PedalType type = PedalType(rawType);
-
-			if(currentPedals.count(type) > 0){
-				// Stop the current event, store it.
-				const auto & pedalTuple = currentPedals[type];
-				const size_t start = std::get<0>(pedalTuple);
-				const size_t end = timeInUnits;
-				// Create the final pedal with timing.
-				// Look for the start and end timestamps using the tempos and their timestamps.
-
-				const auto times = computeNoteTimings(tempos, start, end, unitsPerQuarterNote);
-				const double duration = times.second - times.first;
-				if(duration > 0.0){
-					const float velocity = float(std::get<1>(pedalTuple));
-					_pedals.emplace_back(type, times.first, duration, velocity);
+		if(isNote){
+			// Ensure the ID is in 0-127.
+			const short noteInd = clamp<short>(event.note, 0, 127);
+			const short velocity = clamp<short>(event.velocity, 0, 127);
+			const short channel = event.channel & 0xF;
+			const bool isPress = event.type == noteOn && velocity > 0;
+
+			EventTime start;
+			short startVelocity = 0;
+			if(pairing.note(noteInd, channel, velocity, isPress, { timeInUnits, time }, start, startVelocity)){
+				const MIDINote note(noteInd, start.units, timeInUnits, startVelocity, channel, trackId);
+				_statistics.addNote(note, start.seconds, time - start.seconds);
+				if(streamed()){
+					// Decoding any segment where the note is held should reach this event.
+					for(size_t sid = segmentIndex(start.seconds, _segmentDuration); sid < _segments.size(); ++sid){
+						_segments[sid].endPosition = nextPosition;
+					}
+				} else {
+					_notes.push_back(note);
 				}
-
-				// Remove press.
-				currentPedals.erase(type);
-			}
-			// Check if we have to start a new press.
-			const short val = clamp<short>(event.data[2], 0, 127);
-			const bool shouldNew = val > 0;
-			if(shouldNew){
-				currentPedals[type] = std::make_tuple(timeInUnits, val);
 			}
-
+			_statistics.maxTrackPolyphony = (std::max)(_statistics.maxTrackPolyphony, pairing.heldCount());
+			return;
 		}
-	}
-}
-
-void MIDITrack::getNotes(std::vector<MIDINote> & notes, NoteType type) const {
-	notes.clear();
 
-	for(auto& note : _notes){
-		const bool isMin = noteIsMinor[note.note % 12];
-		const short shiftId = (note.note/12) * 7 + noteShift[note.note % 12];
-		if(type == NoteType::ALL || (type == NoteType::MINOR && isMin) || (type == NoteType::MAJOR && !isMin)){
-			notes.push_back(note);
-			notes.back().note = shiftId;
+		const PedalType type = PedalType(clamp<int>(event.note, 0, 127));
+		const short val = clamp<short>(event.velocity, 0, 127);
+		double start = 0.0;
+		short startVelocity = 0;
+		// Stop the current press if any, store it.
+		if(pairing.pedal(pedalId, val, time, start, startVelocity) && time > start){
+			_pedals.emplace_back(type, start, time - start, float(startVelocity));
 		}
+	};
+
+	MIDIEventReader reader(_chunk);
+	MIDIEvent event;
+	size_t position = reader.position();
+	uint8_t previousFirstByte = reader.previousFirstByte();
+	while(reader.next(event)){
+		processEvent(event, position, reader.position(), previousFirstByte);
+		position = reader.position();
+		previousFirstByte = reader.previousFirstByte();
+	}
+	if(!streamed()){
+		// All notes are extracted, the track bytes are not needed anymore.
+		_chunk = ByteSpan();
 	}
 
+	// Notes and pedals are completed in end order, sort them by start.
+	std::stable_sort(_notes.begin(), _notes.end(), [](const MIDINote & a, const MIDINote & b) { return a.startUnits < b.startUnits; });
+	std::stable_sort(_pedals.begin(), _pedals.end(), [](const MIDIPedal & a, const MIDIPedal & b) { return a.start < b.start; });
 }
 
-void MIDITrack::getNotesActive(ActiveNotesArray & actives, double time) const {
-	// Reset all notes.
-	for(int i = 0; i < int(actives.size()); ++i){
-		 actives[i].enabled = false;
+size_t MIDITrack::decodeSegment(size_t segment, const TempoMap & tempos, unsigned int trackId, NoteOverlap overlap, std::vector<MIDINote> & notes) const {
+	notes.clear();
+	// No note is completed after the last segment start.
+	if(segment >= _segments.size()){
+		return 0;
+	}
+	const SegmentStart & segmentStart = _segments[segment];
+
+	// Resume from the state at the segment start.
+	// The pairing state is large, each thread reuses its own for all the tracks it decodes.
+	thread_local EventPairing pairing(overlap);
+	pairing.reset(overlap);
+	for(uint32_t hid = 0; hid < segmentStart.heldCount; ++hid){
+		const HeldNote & held = _segmentsHeld[segmentStart.firstHeld + hid];
+		pairing.hold(held.slot, { held.start, tempos.secondsAt(held.start) }, held.velocity);
 	}
-	const size_t count = _notes.size();
-	for(size_t i = 0; i < count; ++i){
-		auto& note = _notes[i];
-		if(note.start <= time && note.start+note.duration >= time){
-			auto & actNote = actives[note.note];
-			actNote.enabled = true;
-			actNote.duration = float(note.duration);
-			actNote.start = float(note.start);
-			actNote.set = note.set;
-			actNote.velocity = float(note.velocity);
+	MIDIEventReader reader(_chunk, segmentStart.position, segmentStart.previousFirstByte);
+	size_t timeInUnits = segmentStart.units;
+	TempoMap::Cursor tempoCursor = tempos.cursorAt(timeInUnits);
+
+	size_t carriedCount = 0;
+	MIDIEvent event;
+	size_t position = reader.position();
+	while(reader.next(event)){
+		const size_t eventPosition = position;
+		position = reader.position();
+		timeInUnits += (event.delta);
+		if(event.category != EventCategory::MIDI || (event.type != noteOn && event.type != noteOff)){
+			continue;
+		}
+		const double time = tempos.secondsAt(timeInUnits, tempoCursor);
+		// Past the segment, only continue until all its notes are complete.
+		if(segmentIndex(time, _segmentDuration) > segment && eventPosition >= segmentStart.endPosition){
+			break;
+		}
+		const short noteInd = clamp<short>(event.note, 0, 127);
+		const short velocity = clamp<short>(event.velocity, 0, 127);
+		const short channel = event.channel & 0xF;
+		const bool isPress = event.type == noteOn && velocity > 0;
+
+		EventTime start;
+		short startVelocity = 0;
+		if(!pairing.note(noteInd, channel, velocity, isPress, { timeInUnits, time }, start, startVelocity)){
+			continue;
+		}
+		// Notes starting in later segments are only paired to keep the same state as a full extraction.
+		const size_t startSegment = segmentIndex(start.seconds, _segmentDuration);
+		if(startSegment <= segment){
+			notes.emplace_back(noteInd, start.units, timeInUnits, startVelocity, channel, trackId);
+			carriedCount += startSegment < segment ? 1 : 0;
 		}
 	}
+	// Same order as a full extraction.
+	std::stable_sort(notes.begin(), notes.end(), [](const MIDINote & a, const MIDINote & b) { return a.startUnits < b.startUnits; });
+	return carriedCount;
 }
 
-void MIDITrack::normalizePedalVelocity() {
-	if(_pedals.empty()){
-		return;
-	}
-	// For now we only normalize wrt the upper bound.
-	float maxV = _pedals[0].velocity;
-	float minV = 0.0f;
-	for(size_t pid = 1; pid < _pedals.size(); ++pid){
-		maxV = (std::max)(maxV, _pedals[pid].velocity);
-	}
-	// Renormalize in 0,1.
-	const float denom = 1.0f / (maxV - minV);
-	for(auto & pedal : _pedals){
-		pedal.velocity = (pedal.velocity - minV) * denom;
-	}
+size_t MIDITrack::segmentIndex(double time, double segmentDuration){
+	const double index = std::floor(time / segmentDuration);
+	return index > 0.0 ? size_t(index) : 0;
 }
 
-void MIDITrack::getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double time) const {
-	damper = sostenuto = soft = expression = 0.0f;
-	
-	const size_t count = _pedals.size();
-	for(size_t i = 0; i < count; ++i){
-		auto& pedal = _pedals[i];
-		if(pedal.start <= time && pedal.start+pedal.duration >= time){
-			if(pedal.type == PedalType::DAMPER){
-				damper = pedal.velocity;
-			} else if(pedal.type == PedalType::SOSTENUTO){
-				sostenuto = pedal.velocity;
-			} else if(pedal.type == PedalType::SOFT){
-				soft = pedal.velocity;
-			} else if(pedal.type == PedalType::EXPRESSION){
-				expression = pedal.velocity;
-			}
-			// Early exit (rare).
-			if(damper != 0.0f && sostenuto != 0.0f && soft != 0.0f && expression != 0.0f){
-				break;
-			}
-		}
-	}
+void MIDITrack::indexNotes(const TempoMap & tempos){
+	_notesIndex.build(_notes, tempos);
+}
+
+void MIDITrack::getNotesActive(ActiveNotesArray & actives, double time, const TempoMap & tempos) {
+	_notesIndex.getNotesActive(_notes, tempos, actives, time);
 }
 
 void MIDITrack::print() const {
-	std::cout << "[INFO]: * Events (" << _events.size() << "): " << std::endl;
-	for(auto& event : _events){
-		event.print();
+	if(_events.size() > 0){
+		std::cout << "[INFO]: * Events (" << _events.size() << "): " << std::endl;
+		for(size_t eid = 0; eid < _events.size(); ++eid){
+			_events[eid].print();
+		}
+	} else {
+		std::cout << "[INFO]: * Events not kept in memory, enable keep-events to print them." << std::endl;
 	}
 	std::cout << "[INFO]: * Notes (" << _notes.size() << "): " << std::endl;
 	for(auto& note : _notes){
@@ -275,47 +409,94 @@ void MIDITrack::print() const {
 	}
 }
 
-void MIDITrack::merge(MIDITrack & other){
-	for(auto& note : other._notes){
-		_notes.push_back(note);
+void MIDITrack::merge(const std::vector<MIDITrack> & tracks){
+	std::vector<const std::vector<MIDINote>*> notes;
+	std::vector<const std::vector<MIDIPedal>*> pedals;
+	for(const auto & track : tracks){
+		notes.push_back(&track._notes);
+		pedals.push_back(&track._pedals);
 	}
-	std::sort(_notes.begin(), _notes.end(), [](const MIDINote & a, const MIDINote & b) { return(a.start < b.start); } );
-
-	for(auto& pedal : other._pedals){
-		_pedals.push_back(pedal);
+	// This track can be part of the list, merge in new storage.
+	std::vector<MIDINote> mergedNotes;
+	std::vector<MIDIPedal> mergedPedals;
+	mergeSorted(notes, mergedNotes, [](const MIDINote & note){ return note.startUnits; });
+	mergeSortedByStart(pedals, mergedPedals);
+	std::swap(_notes, mergedNotes);
+	std::swap(_pedals, mergedPedals);
+
+	MIDIStatistics statistics;
+	for(const auto & track : tracks){
+		statistics.merge(track._statistics);
 	}
-	std::sort(_pedals.begin(), _pedals.end(), [](const MIDIPedal & a, const MIDIPedal & b) { return(a.start < b.start); } );
+	_statistics = statistics;
 }
 
-std::pair<double, double> MIDITrack::computeNoteTimings(const std::vector<MIDITempo> & tempos, size_t start,size_t end, uint16_t upqn) const {
-	double startTime;
-	double endTime;
-
-	size_t tid = 0;
-	for(; tid < tempos.size(); ++tid){
-		if((tid == tempos.size() - 1) || (tempos[tid+1].start > start)){
-			// The note started before tid+1, we should use the previous one.
-			startTime = tempos[tid].timestamp + computeUnitsDuration(tempos[tid].tempo, start - tempos[tid].start, upqn);
-			break;
-		}
+size_t MIDITrack::updateSets(const SetOptions & options, const TempoMap & tempos, size_t first, size_t last, std::vector<SetsChange> & changes){
+	last = (std::min)(last, _notes.size());
+	if(first >= last){
+		return 0;
 	}
-	// Start from the same one again.
-	for(; tid < tempos.size(); ++tid){
-		if((tid == tempos.size() - 1) || (tempos[tid+1].start > end)){
-			// The note ended before tid+1, we should use the previous one.
-			endTime = tempos[tid].timestamp + computeUnitsDuration(tempos[tid].tempo, end - tempos[tid].start, upqn);
-			break;
+	// Notes are sorted by start, convert their timings incrementally.
+	TempoMap::Cursor cursor = tempos.cursorAt(_notes[first].startUnits);
+	SetOptions::Cursor setsCursor;
+	const size_t firstChange = changes.size();
+	size_t minorCount = 0;
+	for(size_t nid = first; nid < last; ++nid){
+		MIDINote & note = _notes[nid];
+		const bool isMin = noteIsMinor[note.note % 12];
+		const uint8_t set = uint8_t(options.apply(note.note, note.channel, note.track, tempos.secondsAt(note.startUnits, cursor), setsCursor));
+		if(set != note.set){
+			note.set = set;
+			// Re-sending a few unchanged notes is cheaper than an additional upload.
+			if(changes.size() > firstChange && changes.back().last + kSetsChangeGap >= nid){
+				changes.back().last = nid + 1;
+			} else {
+				changes.emplace_back();
+				changes.back().first = nid;
+				changes.back().last = nid + 1;
+				changes.back().firstMajor = (nid - first) - minorCount;
+				changes.back().firstMinor = minorCount;
+			}
 		}
+		minorCount += isMin ? 1 : 0;
 	}
+	return minorCount;
+}
 
-	startTime /= 1000000.0;
-	endTime /= 1000000.0;
-
-	return std::make_pair(startTime, endTime);
+void MIDITrack::writeCache(CacheWriter & writer) const {
+	writer.writeString(_name);
+	writer.writeString(_instrument);
+	writer.write(uint64_t(_length));
+	writer.write(uint64_t(_minorKey ? 1 : 0));
+	writer.writeArray(_notes);
+	// Statistics.
+	writer.write(_statistics.duration);
+	writer.write(uint64_t(_statistics.notesCount));
+	writer.write(int32_t(_statistics.minKey));
+	writer.write(int32_t(_statistics.maxKey));
+	writer.write(_statistics.channelCounts);
+	writer.write(uint64_t(_statistics.maxTrackPolyphony));
+	writer.writeArray(_statistics.density);
 }
 
-void MIDITrack::updateSets(const SetOptions & options){
-	for(auto & note : _notes){
-		note.set = options.apply(note.note, note.channel, note.track, note.start);
-	}
+bool MIDITrack::readCache(CacheReader & reader){
+	uint64_t length = 0;
+	uint64_t minorKey = 0;
+	uint64_t notesCount = 0;
+	uint64_t maxTrackPolyphony = 0;
+	int32_t minKey = 0;
+	int32_t maxKey = 0;
+	const bool success = reader.readString(_name) && reader.readString(_instrument)
+		&& reader.read(length) && reader.read(minorKey) && reader.readArray(_notes)
+		&& reader.read(_statistics.duration) && reader.read(notesCount)
+		&& reader.read(minKey) && reader.read(maxKey)
+		&& reader.read(_statistics.channelCounts) && reader.read(maxTrackPolyphony)
+		&& reader.readArray(_statistics.density);
+	_length = size_t(length);
+	_minorKey = minorKey != 0;
+	_statistics.notesCount = size_t(notesCount);
+	_statistics.minKey = short(minKey);
+	_statistics.maxKey = short(maxKey);
+	_statistics.maxTrackPolyphony = size_t(maxTrackPolyphony);
+	return success;
 }
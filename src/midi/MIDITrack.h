@@ -2,43 +2,116 @@
 #define MIDI_TRACK_H
 
 #include "MIDIBase.h"
-
-typedef std::array<ActiveNoteInfos, 128> ActiveNotesArray;
+#include "TempoMap.h"
+#include "NotesIndex.h"
+#include "MIDICache.h"
+
+/// Consecutive notes of a track whose sets changed, see MIDITrack::updateSets.
+struct SetsChange {
+	size_t first = 0; ///< Index of the first note in the track.
+	size_t last = 0; ///< Past the last note.
+	size_t firstMajor = 0; ///< Index of the first major note among major notes, relative to the updated range.
+	size_t firstMinor = 0; ///< Same for minor notes.
+};
 
 class MIDITrack {
 public:
 	
-	size_t readTrack(const std::vector<char>& buffer, size_t pos);
+	/// Prepare a track for extracting its notes. The buffer should stay valid until they are extracted.
+	/// Events are only stored if requested, for debugging.
+	void readTrack(const ByteSpan& buffer, bool keepEvents);
+
+	/// Prepare a track for decoding its notes on demand, one time segment at a time, without storing its events.
+	/// The buffer should stay valid as long as the track is used.
+	void streamTrack(const ByteSpan& buffer, double segmentDuration);
+
+	bool streamed() const { return _segmentDuration > 0.0; }
+
+	void printInfos() const;
 	
 	double extractTempos(std::vector<MIDITempo> & tempos) const;
 
-	void extractNotes(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote, unsigned int trackId);
+	/// For streamed tracks, notes are not stored but the state at the start of each segment is recorded.
+	void extractNotes(const TempoMap & tempos, unsigned int trackId, NoteOverlap overlap);
+
+	/// Decode the notes starting during a time segment, and the ones started earlier still held at its beginning.
+	/// Only for streamed tracks. Notes are sorted by start, so notes carried from previous segments come first.
+	/// \return the number of carried notes
+	size_t decodeSegment(size_t segment, const TempoMap & tempos, unsigned int trackId, NoteOverlap overlap, std::vector<MIDINote> & notes) const;
+
+	static size_t segmentIndex(double time, double segmentDuration);
 
 	void print() const;
 
-	void getNotes(std::vector<MIDINote> & notes, NoteType type) const;
+	const MIDIEventList & events() const { return _events; }
+
+	size_t notesCount() const { return _notes.size(); }
 
-	void getNotesActive(ActiveNotesArray & actives, double time) const;
+	/// Notes sorted by start, with their original key. Empty for streamed tracks.
+	const std::vector<MIDINote> & notes() const { return _notes; }
 
-	void normalizePedalVelocity();
+	void indexNotes(const TempoMap & tempos);
 
-	void getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double time) const;
+	void getNotesActive(ActiveNotesArray & actives, double time, const TempoMap & tempos);
+
+	const std::vector<MIDIPedal> & pedals() const { return _pedals; }
+
+	const std::string & name() const { return _name; }
+
+	const MIDIStatistics & statistics() const { return _statistics; }
 	
-	void merge(MIDITrack & other);
+	void merge(const std::vector<MIDITrack> & tracks);
 
-	void updateSets(const SetOptions & options);
+	/// Reassign the sets of the notes in [first, last). Distinct ranges can be updated in parallel.
+	/// Notes whose set changed are appended as spans, close spans being merged.
+	/// \return the number of minor notes in the range
+	size_t updateSets(const SetOptions & options, const TempoMap & tempos, size_t first, size_t last, std::vector<SetsChange> & changes);
 
-private:
+	void writeCache(CacheWriter & writer) const;
 
-	std::pair<double, double> computeNoteTimings(const std::vector<MIDITempo> & tempos, size_t start,size_t end, uint16_t upqn) const;
+	bool readCache(CacheReader & reader);
 
-	std::vector<MIDIEvent> _events;
+private:
+
+	/// Scan meta events for track infos, tempos and the signature.
+	void readMetaEvents();
+
+	/// Note held when a segment starts.
+	struct HeldNote {
+		size_t start; ///< In units.
+		short velocity;
+		uint16_t slot; ///< Channel and key.
+	};
+
+	/// Where to resume decoding for a time segment.
+	struct SegmentStart {
+		size_t position = 0; ///< First event to decode in the track bytes.
+		size_t units = 0; ///< Time in units before this event.
+		size_t endPosition = 0; ///< Past the segment end, all its notes are complete after this position.
+		uint32_t firstHeld = 0; ///< Notes held at the segment start, in _segmentsHeld.
+		uint32_t heldCount = 0;
+		uint8_t previousFirstByte = 0x0; ///< For running status.
+	};
+
+	MIDIEventList _events; ///< Only kept for debugging.
 	std::vector<MIDINote> _notes;
+	NotesIndex _notesIndex;
 	std::vector<MIDIPedal> _pedals;
+	MIDIStatistics _statistics;
 
 	std::string _name;
 	std::string _instrument;
-	uint8_t _previousEventFirstByte = 0x0;
+	size_t _length = 0;
+	bool _minorKey = false;
+	std::vector<MIDITempo> _tempos;
+	double _signature = 4.0/4.0;
+
+	ByteSpan _chunk; ///< Track bytes, only valid until notes are extracted unless streamed.
+
+	// Streaming.
+	double _segmentDuration = 0.0; ///< Non-zero if notes are decoded on demand instead of stored.
+	std::vector<SegmentStart> _segments;
+	std::vector<HeldNote> _segmentsHeld;
 
 };
 
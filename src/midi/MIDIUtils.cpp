@@ -1,5 +1,10 @@
 #include "MIDIUtils.h"
 
+void outOfBoundsRead(size_t position, size_t size){
+	std::cerr << "[ERROR]: Unexpected end of data (reading up to byte " << position << " of " << size << ")." << std::endl;
+	throw "BadInput";
+}
+
 std::unordered_map<MIDIEventType, std::string> MIDIEventTypeName = {
 	{ noteOff, "noteOff"},
 	{ noteOn, "noteOn"},
@@ -7,6 +7,7 @@
 #include <string>
 #include <iostream>
 #include <array>
+#include <algorithm>
 
 struct SetOptions;
 
@@ -45,12 +46,15 @@ enum MIDIEventType : uint8_t {
 	
 };
 
-enum class EventCategory {
+enum class EventCategory : uint8_t {
 	MIDI, SYSTEM, META
 };
 
-enum class NoteType{
-	MAJOR, MINOR, ALL
+/// How to pair note-on and note-off events when a key is pressed again before being released.
+enum class NoteOverlap : uint8_t {
+	RETRIGGER = 0, ///< A new note-on ends the held note.
+	FIFO = 1, ///< Notes overlap, each note-off ends the oldest held note.
+	LIFO = 2 ///< Notes overlap, each note-off ends the most recent held note.
 };
 
 enum PedalType : uint8_t {
@@ -73,31 +77,63 @@ extern const char* midiKeysStrings[];
 
 // Read data.
 
-inline uint32_t read32(const std::vector<char>& buffer, size_t position){
-	return (buffer[position] & 0xFF) << 24 | (buffer[position+1] & 0xFF) << 16 | (buffer[position+2] & 0xFF) << 8 | (buffer[position+3] & 0xFF);
+/// Read-only view on a range of raw bytes (usually a memory-mapped MIDI file).
+/// All read functions below check that they stay inside the view.
+struct ByteSpan {
+
+	ByteSpan() = default;
+
+	ByteSpan(const uint8_t * aData, size_t aSize) : data(aData), size(aSize) {}
+
+	/// Extract a sub-range, clamped to the current view.
+	ByteSpan subspan(size_t offset, size_t length) const {
+		offset = (std::min)(offset, size);
+		return ByteSpan(data + offset, (std::min)(length, size - offset));
+	}
+
+	const uint8_t * data = nullptr;
+	size_t size = 0;
+};
+
+/// Report and throw when trying to read outside of a byte span.
+[[noreturn]] void outOfBoundsRead(size_t position, size_t size);
+
+inline void checkBounds(const ByteSpan& buffer, size_t position, size_t count){
+	if(position + count > buffer.size || position + count < position){
+		outOfBoundsRead(position + count, buffer.size);
+	}
+}
+
+inline uint32_t read32(const ByteSpan& buffer, size_t position){
+	checkBounds(buffer, position, 4);
+	const uint8_t* bytes = buffer.data + position;
+	return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 | uint32_t(bytes[2]) << 8 | uint32_t(bytes[3]);
 }
 
 inline uint8_t getBit(uint32_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline uint16_t read16(const std::vector<char>& buffer, size_t position){
-	return (buffer[position] & 0xFF) << 8 | (buffer[position+1] & 0xFF);
+inline uint16_t read16(const ByteSpan& buffer, size_t position){
+	checkBounds(buffer, position, 2);
+	const uint8_t* bytes = buffer.data + position;
+	return uint16_t(bytes[0] << 8 | bytes[1]);
 }
 
 inline uint8_t getBit(uint16_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline uint8_t read8(const std::vector<char>& buffer, size_t position){
-	return buffer[position] & 0xFF;
+inline uint8_t read8(const ByteSpan& buffer, size_t position){
+	checkBounds(buffer, position, 1);
+	return buffer.data[position];
 }
 
 inline uint8_t getBit(uint8_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline size_t readVarLen(const std::vector<char>& buffer, size_t & position){
+inline size_t readVarLen(const ByteSpan& buffer, size_t & position){
 	size_t lastIndex = 0;
 	size_t accum = 0;
 	uint8_t currentByte = read8(buffer, position + lastIndex);
@@ -111,6 +147,12 @@ inline size_t readVarLen(const std::vector<char>& buffer, size_t & position){
 	return accum;
 }
 
+inline bool matchesTag(const ByteSpan& buffer, size_t position, const char tag[4]){
+	checkBounds(buffer, position, 4);
+	const uint8_t* bytes = buffer.data + position;
+	return bytes[0] == uint8_t(tag[0]) && bytes[1] == uint8_t(tag[1]) && bytes[2] == uint8_t(tag[2]) && bytes[3] == uint8_t(tag[3]);
+}
+
 // Time computations.
 
 inline double computeMeasureDuration(int tempo, double signature){
@@ -128,5 +170,62 @@ T clamp(T x, T a, T b) {
 	return (std::min)((std::max)(x, a), b);
 }
 
+// Visit the elements of lists sorted by a key in a single pass, in merged order. Elements with the same key are visited in list order.
+template<typename T, typename K, typename Visitor>
+void forEachSorted(const std::vector<const std::vector<T>*> & lists, K key, Visitor visitor){
+	struct Head {
+		double start;
+		size_t list;
+		size_t pos;
+	};
+	// Heap ordering, the head with the smallest start (then list index) is on top.
+	const auto after = [](const Head & a, const Head & b){
+		return a.start > b.start || (a.start == b.start && a.list > b.list);
+	};
+
+	std::vector<Head> heads;
+	heads.reserve(lists.size());
+	for(size_t lid = 0; lid < lists.size(); ++lid){
+		if(!lists[lid]->empty()){
+			heads.push_back({ double(key((*lists[lid])[0])), lid, 0 });
+		}
+	}
+	std::make_heap(heads.begin(), heads.end(), after);
+
+	while(!heads.empty()){
+		std::pop_heap(heads.begin(), heads.end(), after);
+		Head & head = heads.back();
+		const std::vector<T> & list = *lists[head.list];
+		visitor(list[head.pos]);
+		++head.pos;
+		if(head.pos < list.size()){
+			head.start = double(key(list[head.pos]));
+			std::push_heap(heads.begin(), heads.end(), after);
+		} else {
+			heads.pop_back();
+		}
+	}
+}
+
+// Merge lists sorted by a key in a single pass. Elements with the same key are kept in list order.
+template<typename T, typename K>
+void mergeSorted(const std::vector<const std::vector<T>*> & lists, std::vector<T> & result, K key){
+	size_t total = 0;
+	for(const std::vector<T> * list : lists){
+		total += list->size();
+	}
+	result.clear();
+	result.reserve(total);
+	forEachSorted(lists, key, [&result](const T & element){
+		result.push_back(element);
+	});
+}
+
+// Merge lists sorted by start time in a single pass. Elements with the same start are kept in list order.
+template<typename T>
+void mergeSortedByStart(const std::vector<const std::vector<T>*> & lists, std::vector<T> & result){
+	mergeSorted(lists, result, [](const T & element){ return element.start; });
+}
+
 
 #endif // MIDI_UTILS_H
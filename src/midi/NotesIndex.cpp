@@ -0,0 +1,211 @@
+#include "NotesIndex.h"
+#include "TempoMap.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Each level has buckets this many times wider than the previous one.
+static const double kLevelScale = 16.0;
+// A note is stored in the first level where it overlaps at most this many buckets.
+static const size_t kMaxBucketsPerNote = 4;
+// Above this many notes to process, a forward jump restarts the cursor instead.
+static const size_t kMaxSweepCount = 1024;
+
+static size_t bucketIndex(double time, double width, size_t count){
+	const double index = std::floor(time / width);
+	if(!(index > 0.0)){
+		return 0;
+	}
+	return (std::min)(size_t(index), count - 1);
+}
+
+void NotesIndex::build(const std::vector<MIDINote> & notes, const TempoMap & tempos){
+	_levels.clear();
+	_byStart.clear();
+	_byEnd.clear();
+	_cursorValid = false;
+	for(auto & held : _held){
+		held.clear();
+	}
+
+	const size_t count = notes.size();
+	if(count == 0){
+		return;
+	}
+
+	// Convert timings once, notes only store units.
+	// Notes are sorted by start, and ends are close to starts: follow both with cursors.
+	std::vector<double> starts(count);
+	std::vector<double> ends(count);
+	double maxEnd = 0.0;
+	TempoMap::Cursor startCursor;
+	for(size_t nid = 0; nid < count; ++nid){
+		const MIDINote & note = notes[nid];
+		starts[nid] = tempos.secondsAt(note.startUnits, startCursor);
+		TempoMap::Cursor endCursor = startCursor;
+		// Same as MIDINote::end.
+		ends[nid] = starts[nid] + (tempos.secondsAt(note.endUnits, endCursor) - starts[nid]);
+		maxEnd = (std::max)(maxEnd, ends[nid]);
+	}
+	// Aim for a few notes starting in each bucket of the finest level.
+	const double baseWidth = clamp<double>(16.0 * maxEnd / double(count), 0.001, (std::max)(maxEnd, 0.001));
+
+	// Levels until a single bucket covers the whole track.
+	double width = baseWidth;
+	do {
+		_levels.emplace_back();
+		_levels.back().width = width;
+		_levels.back().offsets.assign(size_t(std::floor(maxEnd / width)) + 2, 0);
+		width *= kLevelScale;
+	} while(_levels.back().offsets.size() > 3);
+
+	// Assign each note to a level and count notes per bucket.
+	std::vector<uint8_t> noteLevels(count);
+	for(size_t nid = 0; nid < count; ++nid){
+		size_t lid = 0;
+		for(; lid < _levels.size() - 1; ++lid){
+			const Level & level = _levels[lid];
+			const size_t bucketCount = level.offsets.size() - 1;
+			const size_t first = bucketIndex(starts[nid], level.width, bucketCount);
+			const size_t last = bucketIndex(ends[nid], level.width, bucketCount);
+			if(last - first < kMaxBucketsPerNote){
+				break;
+			}
+		}
+		noteLevels[nid] = uint8_t(lid);
+		Level & level = _levels[lid];
+		const size_t bucketCount = level.offsets.size() - 1;
+		const size_t first = bucketIndex(starts[nid], level.width, bucketCount);
+		const size_t last = bucketIndex(ends[nid], level.width, bucketCount);
+		for(size_t bid = first; bid <= last; ++bid){
+			++level.offsets[bid + 1];
+		}
+	}
+	// Prefix sums, then fill buckets.
+	for(auto & level : _levels){
+		for(size_t bid = 1; bid < level.offsets.size(); ++bid){
+			level.offsets[bid] += level.offsets[bid - 1];
+		}
+		level.notes.resize(level.offsets.back());
+	}
+	std::vector<std::vector<uint32_t>> fillPositions(_levels.size());
+	for(size_t lid = 0; lid < _levels.size(); ++lid){
+		fillPositions[lid] = _levels[lid].offsets;
+	}
+	for(size_t nid = 0; nid < count; ++nid){
+		Level & level = _levels[noteLevels[nid]];
+		std::vector<uint32_t> & positions = fillPositions[noteLevels[nid]];
+		const size_t bucketCount = level.offsets.size() - 1;
+		const size_t first = bucketIndex(starts[nid], level.width, bucketCount);
+		const size_t last = bucketIndex(ends[nid], level.width, bucketCount);
+		for(size_t bid = first; bid <= last; ++bid){
+			level.notes[positions[bid]++] = uint32_t(nid);
+		}
+	}
+
+	// Sorted boundaries for the playback cursor.
+	_byStart.resize(count);
+	for(size_t nid = 0; nid < count; ++nid){
+		_byStart[nid] = uint32_t(nid);
+	}
+	_byEnd = _byStart;
+	std::stable_sort(_byStart.begin(), _byStart.end(), [&starts](uint32_t a, uint32_t b){
+		return starts[a] < starts[b];
+	});
+	std::stable_sort(_byEnd.begin(), _byEnd.end(), [&ends](uint32_t a, uint32_t b){
+		return ends[a] < ends[b];
+	});
+}
+
+void NotesIndex::hold(const MIDINote & note, uint32_t id){
+	_held[note.note & 127].push_back(id);
+}
+
+void NotesIndex::release(const MIDINote & note, uint32_t id){
+	std::vector<uint32_t> & held = _held[note.note & 127];
+	const auto it = std::find(held.begin(), held.end(), id);
+	if(it != held.end()){
+		*it = held.back();
+		held.pop_back();
+	}
+}
+
+void NotesIndex::seek(const std::vector<MIDINote> & notes, const TempoMap & tempos, double time){
+	for(auto & held : _held){
+		held.clear();
+	}
+	for(const auto & level : _levels){
+		const size_t bid = bucketIndex(time, level.width, level.offsets.size() - 1);
+		for(uint32_t i = level.offsets[bid]; i < level.offsets[bid + 1]; ++i){
+			const uint32_t id = level.notes[i];
+			const MIDINote & note = notes[id];
+			if(note.start(tempos) <= time && note.end(tempos) >= time){
+				hold(note, id);
+			}
+		}
+	}
+
+	_nextStart = std::upper_bound(_byStart.begin(), _byStart.end(), time, [&notes, &tempos](double t, uint32_t id){
+		return t < notes[id].start(tempos);
+	}) - _byStart.begin();
+	_nextEnd = std::lower_bound(_byEnd.begin(), _byEnd.end(), time, [&notes, &tempos](uint32_t id, double t){
+		return notes[id].end(tempos) < t;
+	}) - _byEnd.begin();
+	_time = time;
+	_cursorValid = true;
+}
+
+void NotesIndex::advance(const std::vector<MIDINote> & notes, const TempoMap & tempos, double time){
+	// Notes starting before the new time become active...
+	const size_t count = _byStart.size();
+	while(_nextStart < count && notes[_byStart[_nextStart]].start(tempos) <= time){
+		const uint32_t id = _byStart[_nextStart];
+		hold(notes[id], id);
+		++_nextStart;
+	}
+	// ...and notes ending before it are released. They have all been activated already.
+	while(_nextEnd < count && notes[_byEnd[_nextEnd]].end(tempos) < time){
+		const uint32_t id = _byEnd[_nextEnd];
+		release(notes[id], id);
+		++_nextEnd;
+	}
+	_time = time;
+}
+
+void NotesIndex::getNotesActive(const std::vector<MIDINote> & notes, const TempoMap & tempos, ActiveNotesArray & actives, double time){
+	// Reset all notes.
+	for(int i = 0; i < int(actives.size()); ++i){
+		 actives[i].enabled = false;
+	}
+	if(_byStart.empty()){
+		return;
+	}
+
+	if(!_cursorValid || time < _time){
+		seek(notes, tempos, time);
+	} else {
+		// Avoid sweeping over a large part of the track when jumping forward.
+		const size_t lastStart = (std::min)(_byStart.size(), _nextStart + kMaxSweepCount);
+		if(lastStart < _byStart.size() && notes[_byStart[lastStart]].start(tempos) <= time){
+			seek(notes, tempos, time);
+		} else {
+			advance(notes, tempos, time);
+		}
+	}
+
+	for(size_t key = 0; key < _held.size(); ++key){
+		const std::vector<uint32_t> & held = _held[key];
+		if(held.empty()){
+			continue;
+		}
+		// Keep the last note in the list, as a linear scan would.
+		const uint32_t id = *std::max_element(held.begin(), held.end());
+		const MIDINote & note = notes[id];
+		auto & actNote = actives[key];
+		actNote.enabled = true;
+		actNote.duration = float(note.duration(tempos));
+		actNote.start = float(note.start(tempos));
+		actNote.set = note.set;
+		actNote.velocity = float(note.velocity);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef NOTES_INDEX_H
+#define NOTES_INDEX_H
+
+#include "MIDIBase.h"
+
+/// Index of notes by time, to retrieve the notes active at a given time without scanning all notes.
+/// Notes are stored in time buckets, in levels of increasing bucket width so that long notes are not duplicated in many buckets.
+/// A cursor follows forward playback incrementally, only processing notes starting or ending since the previous query.
+class NotesIndex {
+public:
+
+	/// Build the index for a list of notes, timed with a tempo map. The list should not be modified afterwards, except for non-timing attributes.
+	void build(const std::vector<MIDINote> & notes, const TempoMap & tempos);
+
+	/// Find the notes active at a given time. If multiple notes are active on the same key, the last one in the list is used.
+	void getNotesActive(const std::vector<MIDINote> & notes, const TempoMap & tempos, ActiveNotesArray & actives, double time);
+
+private:
+
+	/// Restart the cursor at a given time, querying the buckets.
+	void seek(const std::vector<MIDINote> & notes, const TempoMap & tempos, double time);
+
+	/// Move the cursor forward to a given time.
+	void advance(const std::vector<MIDINote> & notes, const TempoMap & tempos, double time);
+
+	void hold(const MIDINote & note, uint32_t id);
+
+	void release(const MIDINote & note, uint32_t id);
+
+	struct Level {
+		double width = 1.0;
+		std::vector<uint32_t> offsets; ///< Notes of bucket i are in [offsets[i], offsets[i+1]).
+		std::vector<uint32_t> notes;
+	};
+
+	std::vector<Level> _levels;
+	std::vector<uint32_t> _byStart; ///< Notes sorted by start time.
+	std::vector<uint32_t> _byEnd; ///< Notes sorted by end time.
+
+	// Playback cursor.
+	std::array<std::vector<uint32_t>, 128> _held; ///< Notes active at the cursor time, per key.
+	size_t _nextStart = 0; ///< First note in _byStart that starts after the cursor time.
+	size_t _nextEnd = 0; ///< First note in _byEnd that ends at or after the cursor time.
+	double _time = 0.0;
+	bool _cursorValid = false;
+};
+
+#endif // NOTES_INDEX_H
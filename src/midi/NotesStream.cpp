@@ -0,0 +1,197 @@
+#include "NotesStream.h"
+#include "../helpers/MappedFile.h"
+#include "../helpers/System.h"
+
+#include <algorithm>
+
+// Maximum count of segments in a window, to bound memory usage when zoomed out.
+static const size_t kMaxWindowSegments = 32;
+// Segments decoded ahead of the window.
+static const size_t kPrefetchSegments = 2;
+
+NotesStream::NotesStream(const std::shared_ptr<MappedFile> & input, std::vector<MIDITrack> & tracks, const TempoMap & tempos, NoteOverlap overlap, double segmentDuration, double duration) :
+	_input(input), _tempos(tempos), _overlap(overlap), _segmentDuration(segmentDuration) {
+	std::swap(_tracks, tracks);
+	_segmentsCount = MIDITrack::segmentIndex(duration, _segmentDuration) + 1;
+	_thread = std::thread(&NotesStream::run, this);
+}
+
+NotesStream::~NotesStream(){
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_all();
+	_thread.join();
+}
+
+size_t NotesStream::segmentIndex(double time) const {
+	return (std::min)(MIDITrack::segmentIndex(time, _segmentDuration), _segmentsCount - 1);
+}
+
+bool NotesStream::setWindow(double start, double end){
+	const size_t first = segmentIndex(start);
+	const size_t last = (std::min)(segmentIndex(end), first + kMaxWindowSegments - 1);
+	const size_t count = last - first + 1;
+
+	// Decode the window first, then the following segments.
+	std::vector<size_t> requested;
+	for(size_t sid = first; sid <= (std::min)(last + kPrefetchSegments, _segmentsCount - 1); ++sid){
+		requested.push_back(sid);
+	}
+
+	std::vector<std::shared_ptr<Segment>> window(count);
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_requested = requested;
+		// Release segments that are not needed anymore.
+		for(auto it = _resident.begin(); it != _resident.end();){
+			if(it->first < first || it->first > requested.back()){
+				it = _resident.erase(it);
+			} else {
+				++it;
+			}
+		}
+		_condition.notify_all();
+		_condition.wait(lock, [this, first, last]{
+			if(_error){
+				return true;
+			}
+			for(size_t sid = first; sid <= last; ++sid){
+				if(_resident.count(sid) == 0){
+					return false;
+				}
+			}
+			return true;
+		});
+		if(_error){
+			std::rethrow_exception(_error);
+		}
+		for(size_t sid = 0; sid < count; ++sid){
+			window[sid] = _resident[first + sid];
+		}
+	}
+
+	bool changed = first != _windowFirst || window != _window;
+	for(auto & segment : window){
+		if(segment->setsVersion != _setsVersion){
+			refreshSets(*segment);
+			changed = true;
+		}
+	}
+	_window = window;
+	_windowFirst = first;
+	return changed;
+}
+
+void NotesStream::getNotesActive(ActiveNotesArray & actives, double time, size_t track){
+	const size_t index = segmentIndex(time);
+	if(!_active || _activeIndex != index){
+		// Use the window if possible.
+		if(index >= _windowFirst && index < _windowFirst + _window.size()){
+			_active = _window[index - _windowFirst];
+		} else {
+			_active = acquire(index);
+		}
+		_activeIndex = index;
+	}
+	if(_active->setsVersion != _setsVersion){
+		refreshSets(*_active);
+	}
+	_active->indices[track].getNotesActive(_active->notes[track], _tempos, actives, time);
+}
+
+void NotesStream::updateSets(const SetOptions & options){
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_options = options;
+		++_setsVersion;
+	}
+	// Segments in use are updated when requested again.
+}
+
+void NotesStream::refreshSets(Segment & segment) const {
+	for(auto & notes : segment.notes){
+		// Notes are sorted by start.
+		TempoMap::Cursor cursor;
+		SetOptions::Cursor setsCursor;
+		for(auto & note : notes){
+			note.set = uint8_t(_options.apply(note.note, note.channel, note.track, _tempos.secondsAt(note.startUnits, cursor), setsCursor));
+		}
+	}
+	segment.setsVersion = _setsVersion;
+}
+
+std::shared_ptr<NotesStream::Segment> NotesStream::acquire(size_t segment){
+	std::unique_lock<std::mutex> lock(_mutex);
+	if(std::find(_requested.begin(), _requested.end(), segment) == _requested.end()){
+		_requested.insert(_requested.begin(), segment);
+		_condition.notify_all();
+	}
+	_condition.wait(lock, [this, segment]{
+		return _error || _resident.count(segment) != 0;
+	});
+	if(_error){
+		std::rethrow_exception(_error);
+	}
+	return _resident[segment];
+}
+
+std::shared_ptr<NotesStream::Segment> NotesStream::decode(size_t segment, const SetOptions & options, unsigned int setsVersion) const {
+	std::shared_ptr<Segment> result = std::make_shared<Segment>();
+	const size_t tracksCount = _tracks.size();
+	result->notes.resize(tracksCount);
+	result->carriedCounts.resize(tracksCount);
+	result->indices.resize(tracksCount);
+	System::forParallel(0, tracksCount, [this, segment, &result, &options](size_t tid){
+		std::vector<MIDINote> & notes = result->notes[tid];
+		result->carriedCounts[tid] = _tracks[tid].decodeSegment(segment, _tempos, (unsigned int)tid, _overlap, notes);
+		TempoMap::Cursor cursor;
+		SetOptions::Cursor setsCursor;
+		for(auto & note : notes){
+			note.set = uint8_t(options.apply(note.note, note.channel, note.track, _tempos.secondsAt(note.startUnits, cursor), setsCursor));
+		}
+		result->indices[tid].build(notes, _tempos);
+	});
+	result->setsVersion = setsVersion;
+	return result;
+}
+
+void NotesStream::run(){
+	std::unique_lock<std::mutex> lock(_mutex);
+	while(true){
+		// Find the first requested segment that is not decoded yet.
+		size_t next = _segmentsCount;
+		_condition.wait(lock, [this, &next]{
+			for(const size_t sid : _requested){
+				if(_resident.count(sid) == 0){
+					next = sid;
+					return true;
+				}
+			}
+			return _stop;
+		});
+		if(_stop){
+			return;
+		}
+		const SetOptions options = _options;
+		const unsigned int setsVersion = _setsVersion;
+		lock.unlock();
+		std::shared_ptr<Segment> segment;
+		try {
+			segment = decode(next, options, setsVersion);
+		} catch(...){
+			// Waiting threads would never get the segment, let them rethrow instead.
+			lock.lock();
+			_error = std::current_exception();
+			_condition.notify_all();
+			return;
+		}
+		lock.lock();
+		// The window might have moved in the meantime.
+		if(std::find(_requested.begin(), _requested.end(), next) != _requested.end()){
+			_resident[next] = segment;
+		}
+		_condition.notify_all();
+	}
+}
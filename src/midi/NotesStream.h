@@ -0,0 +1,107 @@
+#ifndef NOTES_STREAM_H
+#define NOTES_STREAM_H
+
+#include "MIDITrack.h"
+#include "../rendering/SetOptions.h"
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <map>
+#include <exception>
+
+class MappedFile;
+
+/// Keep the notes of a sliding window of time segments in memory, for files too large to extract all notes at once.
+/// Segments are decoded from the file bytes by a background thread, ahead of the current window.
+class NotesStream {
+public:
+
+	/// Take ownership of streamed tracks, decoded from the content of the input file.
+	NotesStream(const std::shared_ptr<MappedFile> & input, std::vector<MIDITrack> & tracks, const TempoMap & tempos, NoteOverlap overlap, double segmentDuration, double duration);
+
+	~NotesStream();
+
+	NotesStream(const NotesStream &) = delete;
+	NotesStream & operator=(const NotesStream &) = delete;
+
+	/// Select the segments overlapping a time range, waiting for them to be decoded if needed.
+	/// The following segments are then decoded in the background.
+	/// If decoding failed in the background, its exception is rethrown.
+	/// \return true if the notes in the window changed
+	bool setWindow(double start, double end);
+
+	/// Call a function on each note of a track in the current window, sorted by start, with its original key.
+	template<typename Visitor>
+	void forEachNote(size_t track, Visitor visitor) const {
+		if(track >= _tracks.size()){
+			return;
+		}
+		for(size_t sid = 0; sid < _window.size(); ++sid){
+			const Segment & segment = *_window[sid];
+			const std::vector<MIDINote> & notes = segment.notes[track];
+			// Notes carried from a previous segment are already visited, except for the first one.
+			for(size_t nid = (sid == 0 ? 0 : segment.carriedCounts[track]); nid < notes.size(); ++nid){
+				visitor(notes[nid]);
+			}
+		}
+	}
+
+	void getNotesActive(ActiveNotesArray & actives, double time, size_t track);
+
+	void updateSets(const SetOptions & options);
+
+	const std::vector<MIDITrack> & tracks() const { return _tracks; }
+
+private:
+
+	struct Segment {
+		std::vector<std::vector<MIDINote>> notes; ///< Per track, notes carried from previous segments first.
+		std::vector<size_t> carriedCounts; ///< Per track.
+		std::vector<NotesIndex> indices; ///< Per track.
+		unsigned int setsVersion = 0;
+	};
+
+	/// Decode a segment for all tracks.
+	std::shared_ptr<Segment> decode(size_t segment, const SetOptions & options, unsigned int setsVersion) const;
+
+	/// Decoding loop of the background thread.
+	void run();
+
+	/// Wait for a segment to be decoded, decoding it first if it was not requested.
+	/// If decoding failed in the background, its exception is rethrown.
+	std::shared_ptr<Segment> acquire(size_t segment);
+
+	/// Reapply sets if options changed since the segment was decoded.
+	void refreshSets(Segment & segment) const;
+
+	size_t segmentIndex(double time) const;
+
+	// Owned by the calling thread.
+	std::vector<std::shared_ptr<Segment>> _window;
+	size_t _windowFirst = 0;
+	std::shared_ptr<Segment> _active; ///< Segment used for active notes.
+	size_t _activeIndex = 0;
+
+	// Immutable after construction.
+	std::shared_ptr<MappedFile> _input; ///< Keep the bytes of the tracks alive.
+	std::vector<MIDITrack> _tracks;
+	TempoMap _tempos;
+	NoteOverlap _overlap;
+	double _segmentDuration;
+	size_t _segmentsCount;
+
+	// Shared with the background thread.
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::map<size_t, std::shared_ptr<Segment>> _resident; ///< Decoded segments.
+	std::vector<size_t> _requested; ///< Segments to keep in memory, in decoding order.
+	SetOptions _options;
+	unsigned int _setsVersion = 0;
+	std::exception_ptr _error; ///< Set if decoding failed, the background thread then stops.
+	bool _stop = false;
+	std::thread _thread;
+};
+
+#endif // NOTES_STREAM_H
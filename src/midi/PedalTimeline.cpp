@@ -0,0 +1,90 @@
+#include "PedalTimeline.h"
+
+#include <cmath>
+#include <limits>
+#include <set>
+
+void PedalTimeline::build(const std::vector<MIDIPedal> & pedals, PedalType type){
+	_steps.clear();
+
+	// Each press is active on [start, end], so its release happens just after the end.
+	struct Change {
+		double time;
+		uint32_t id;
+		bool press;
+	};
+	std::vector<Change> changes;
+	for(size_t pid = 0; pid < pedals.size(); ++pid){
+		const MIDIPedal & pedal = pedals[pid];
+		if(pedal.type != type){
+			continue;
+		}
+		const double end = std::nextafter(pedal.start + pedal.duration, std::numeric_limits<double>::infinity());
+		changes.push_back({pedal.start, uint32_t(pid), true});
+		changes.push_back({end, uint32_t(pid), false});
+	}
+	std::sort(changes.begin(), changes.end(), [](const Change & a, const Change & b){
+		return a.time < b.time;
+	});
+
+	// Sweep over changes, keeping the pressed pedals sorted by position in the list.
+	std::set<uint32_t> pressed;
+	size_t cid = 0;
+	while(cid < changes.size()){
+		const double time = changes[cid].time;
+		for(; cid < changes.size() && changes[cid].time == time; ++cid){
+			if(changes[cid].press){
+				pressed.insert(changes[cid].id);
+			} else {
+				pressed.erase(changes[cid].id);
+			}
+		}
+		const float value = pressed.empty() ? 0.0f : pedals[*pressed.rbegin()].velocity;
+		const float previous = _steps.empty() ? 0.0f : _steps.back().value;
+		if(value != previous){
+			_steps.push_back({time, value});
+		}
+	}
+}
+
+void PedalTimeline::setValue(double time, float value){
+	if(_steps.empty() || _steps.back().time < time){
+		_steps.push_back({time, value});
+		return;
+	}
+	// Rare case of an insertion in the past.
+	const size_t index = stepsBefore(time);
+	if(index > 0 && _steps[index - 1].time == time){
+		_steps[index - 1].value = value;
+		return;
+	}
+	_steps.insert(_steps.begin() + index, {time, value});
+}
+
+size_t PedalTimeline::stepsBefore(double time) const {
+	const auto next = std::upper_bound(_steps.begin(), _steps.end(), time, [](double t, const Step & step){
+		return t < step.time;
+	});
+	return size_t(std::distance(_steps.begin(), next));
+}
+
+float PedalTimeline::valueAt(double time) const {
+	const size_t count = stepsBefore(time);
+	return count == 0 ? 0.0f : _steps[count - 1].value;
+}
+
+float PedalTimeline::valueAt(double time, Cursor & cursor) const {
+	// The cursor stores the number of steps before the previous query time.
+	const size_t count = _steps.size();
+	const size_t maxWalk = 8;
+	if(cursor.index > count || (cursor.index > 0 && _steps[cursor.index - 1].time > time)
+	   || (cursor.index + maxWalk < count && _steps[cursor.index + maxWalk].time <= time)){
+		// Going backward or jumping far ahead, restart from scratch.
+		cursor.index = stepsBefore(time);
+	} else {
+		while(cursor.index < count && _steps[cursor.index].time <= time){
+			++cursor.index;
+		}
+	}
+	return cursor.index == 0 ? 0.0f : _steps[cursor.index - 1].value;
+}
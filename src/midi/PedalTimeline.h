@@ -0,0 +1,42 @@
+#ifndef PEDAL_TIMELINE_H
+#define PEDAL_TIMELINE_H
+
+#include "MIDIBase.h"
+
+/// Value of a pedal over time, stored as a sorted step function.
+class PedalTimeline {
+public:
+
+	/// Position of the last lookup, to speed up queries at increasing times.
+	struct Cursor {
+		size_t index = 0;
+	};
+
+	/// Build the timeline from the presses of a given pedal type. When presses overlap, the last one in the list is used.
+	void build(const std::vector<MIDIPedal> & pedals, PedalType type);
+
+	/// Set the value of the pedal from a given time onwards, until the next step.
+	void setValue(double time, float value);
+
+	/// Value of the pedal at a given time, using a binary search. 0 before the first step.
+	float valueAt(double time) const;
+
+	/// Value of the pedal at a given time, starting the search from the cursor. Amortized constant time for increasing times.
+	float valueAt(double time, Cursor & cursor) const;
+
+	size_t size() const { return _steps.size(); }
+
+private:
+
+	/// Number of steps starting at or before a given time.
+	size_t stepsBefore(double time) const;
+
+	struct Step {
+		double time;
+		float value;
+	};
+
+	std::vector<Step> _steps;
+};
+
+#endif // PEDAL_TIMELINE_H
@@ -0,0 +1,64 @@
+#include "TempoMap.h"
+
+#include <algorithm>
+
+TempoMap::TempoMap() : TempoMap({ MIDITempo(0, 500000) }, 1) {
+
+}
+
+TempoMap::TempoMap(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote) : _tempos(tempos), _unitsPerQuarterNote(unitsPerQuarterNote) {
+	if(_tempos.empty() || _tempos[0].start != 0){
+		_tempos.insert(_tempos.begin(), MIDITempo(0, 500000));
+	}
+	// Compute the real time stamp of each tempo.
+	double currentTime = 0.0;
+	_tempos[0].timestamp = 0.0;
+	for(size_t tid = 1; tid < _tempos.size(); ++tid){
+		const int delta = int(_tempos[tid].start) - int(_tempos[tid-1].start);
+		currentTime += computeUnitsDuration(_tempos[tid-1].tempo, delta, _unitsPerQuarterNote);
+		_tempos[tid].timestamp = currentTime;
+	}
+}
+
+size_t TempoMap::tempoIndex(size_t units) const {
+	// Find the last tempo change starting at or before the position.
+	const auto next = std::upper_bound(_tempos.begin(), _tempos.end(), units, [](size_t pos, const MIDITempo & tempo){
+		return pos < tempo.start;
+	});
+	return size_t(std::distance(_tempos.begin(), next)) - 1;
+}
+
+double TempoMap::secondsAt(size_t units, size_t tid) const {
+	const MIDITempo & tempo = _tempos[tid];
+	return (tempo.timestamp + computeUnitsDuration(tempo.tempo, units - tempo.start, _unitsPerQuarterNote)) / 1000000.0;
+}
+
+double TempoMap::secondsAt(size_t units) const {
+	return secondsAt(units, tempoIndex(units));
+}
+
+double TempoMap::secondsAt(size_t units, Cursor & cursor) const {
+	const size_t count = _tempos.size();
+	if(cursor.index >= count || _tempos[cursor.index].start > units){
+		// Going backward, restart from scratch.
+		cursor.index = tempoIndex(units);
+	} else {
+		while(cursor.index + 1 < count && _tempos[cursor.index + 1].start <= units){
+			++cursor.index;
+		}
+	}
+	return secondsAt(units, cursor.index);
+}
+
+TempoMap::Cursor TempoMap::cursorAt(size_t units) const {
+	Cursor cursor;
+	cursor.index = tempoIndex(units);
+	return cursor;
+}
+
+void TempoMap::secondsAt(const size_t * units, size_t count, double * seconds) const {
+	Cursor cursor;
+	for(size_t i = 0; i < count; ++i){
+		seconds[i] = secondsAt(units[i], cursor);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef TEMPO_MAP_H
+#define TEMPO_MAP_H
+
+#include "MIDIBase.h"
+
+/// Sorted tempo changes of a file, with the real time of each change precomputed.
+/// Converts positions in MIDI units to seconds.
+class TempoMap {
+public:
+
+	/// Position of the last lookup, to speed up conversions of increasing positions.
+	struct Cursor {
+		size_t index = 0;
+	};
+
+	/// Default map, using 120 bpm from the start.
+	TempoMap();
+
+	/// Build the map from tempo changes sorted by position, the first one at position 0.
+	TempoMap(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote);
+
+	/// Convert a position to seconds, using a binary search.
+	double secondsAt(size_t units) const;
+
+	/// Convert a position to seconds, starting the search from the cursor. Amortized constant time for increasing positions.
+	double secondsAt(size_t units, Cursor & cursor) const;
+
+	/// Cursor placed at a given position, to resume conversions from there.
+	Cursor cursorAt(size_t units) const;
+
+	/// Convert a list of positions to seconds. Fastest when the positions are sorted.
+	void secondsAt(const size_t * units, size_t count, double * seconds) const;
+
+	const std::vector<MIDITempo> & tempos() const { return _tempos; }
+
+	uint16_t unitsPerQuarterNote() const { return _unitsPerQuarterNote; }
+
+private:
+
+	size_t tempoIndex(size_t units) const;
+
+	double secondsAt(size_t units, size_t tid) const;
+
+	std::vector<MIDITempo> _tempos;
+	uint16_t _unitsPerQuarterNote = 1;
+};
+
+#endif // TEMPO_MAP_H
@@ -38,7 +38,7 @@ int main( int argc, char** argv) {
 	const std::string outputDir = baseDir + "/src/resources/";
 	
 	std::vector<std::string> imagesToLoad = { "flash", "font", "particles"};
-	std::vector<std::string> shadersToLoad = { "background", "flashes", "notes", "particles", "particlesblur", "screenquad", "keys", "backgroundtexture", "pedal", "wave", "fxaa"};
+	std::vector<std::string> shadersToLoad = { "background", "flashes", "notes", "particles", "particlesblur", "screenquad", "keys", "backgroundtexture", "pedal", "wave", "fxaa", "particlesupdate", "particlessimulated"};
 	
 	// Header file.
 	std::ofstream headerFile(outputDir + "data.h");
@@ -105,7 +105,7 @@ int main( int argc, char** argv) {
 		const std::string shaderBasePath = resourcesDir + "shaders/" + shaderName;
 		std::ifstream vertShader(shaderBasePath + ".vert");
 		std::ifstream fragShader(shaderBasePath + ".frag");
-		if(!vertShader.is_open() || !fragShader.is_open()){
+		if(!vertShader.is_open()){
 			std::cerr << "Unable to open handle to shaders input file for " << shaderName << "." << std::endl;
 			continue;
 		}
@@ -119,7 +119,13 @@ int main( int argc, char** argv) {
 			}
 			shadersOutput << buffLine << "\\n ";
 		}
-		shadersOutput << "\"}, " << "\n";
+		shadersOutput << "\"}";
+		// Some vertex shaders are used with another fragment shader, or none.
+		if(!fragShader.is_open()){
+			shadersOutput << (sid == shadersToLoad.size()-1 ? "" : "," ) << "\n";
+			continue;
+		}
+		shadersOutput << ", " << "\n";
 		
 		// Fragment shader content.
 		shadersOutput << "{ \"" << shaderName << "_" << "frag" << "\", \"";
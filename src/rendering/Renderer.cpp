@@ -42,6 +42,8 @@ Renderer::Renderer(const Configuration& config) :
 	_fullscreen = config.fullscreen;
 	_windowSize = config.windowSize;
 	_useTransparency = config.useTransparency && _supportTransparency;
+	_noteOverlap = config.noteOverlap;
+	_streamNotes = config.streamNotes;
 
 	// GL options
 	glEnable(GL_CULL_FACE);
@@ -131,21 +133,54 @@ Renderer::Renderer(const Configuration& config) :
 	// Check setup errors.
 	checkGLError();
 
-	_score.reset(new Score(2.0f));
+	_score.reset(new Score(2.0f, {}));
 	_scene.reset(new MIDISceneEmpty());
 }
 
-Renderer::~Renderer() {}
+// Notes sent to the GPU at each frame when loading in the background.
+static const size_t kUploadNotesPerFrame = 1 << 18;
+
+Renderer::~Renderer() {
+	cancelLoading();
+	// Wait for interrupted loadings to stop.
+	_cancelledLoadings.clear();
+}
 
 bool Renderer::loadFile(const std::string& midiFilePath) {
-	std::shared_ptr<MIDIScene> scene(nullptr);
+	cancelLoading();
+	std::shared_ptr<MIDISceneFile> scene(nullptr);
 
 	try {
-		scene = std::make_shared<MIDISceneFile>(midiFilePath, _state.setOptions);
+		scene = std::make_shared<MIDISceneFile>(midiFilePath, _state.setOptions, _noteOverlap, _streamNotes);
 	} catch(...){
 		// Failed to load.
 		return false;
 	}
+	setFileScene(scene);
+	return true;
+}
+
+void Renderer::loadFileAsync(const std::string& midiFilePath) {
+	cancelLoading();
+
+	_loadingPath = midiFilePath;
+	_loadingProgress = std::make_shared<LoadingProgress>();
+	_loadingSetsVersion = _setsVersion;
+	// Parsing and notes preparation don't need the GPU.
+	_loadingContent = std::async(std::launch::async, [midiFilePath, options = _state.setOptions, overlap = _noteOverlap, streamed = _streamNotes, progress = _loadingProgress](){
+		return MIDISceneFile::load(midiFilePath, options, overlap, streamed, progress.get());
+	});
+}
+
+void Renderer::loadFilesAsync(const std::vector<std::string> & midiFilePaths) {
+	if(midiFilePaths.empty()){
+		return;
+	}
+	loadFileAsync(midiFilePaths[0]);
+	_loadingFallbacks.assign(midiFilePaths.begin() + 1, midiFilePaths.end());
+}
+
+void Renderer::setFileScene(const std::shared_ptr<MIDISceneFile> & scene) {
 	// Player.
 	_timer = -_state.prerollTime;
 	_shouldPlay = false;
@@ -153,9 +188,61 @@ bool Renderer::loadFile(const std::string& midiFilePath) {
 
 	// Init objects.
 	_scene = scene;
-	_score = std::make_shared<Score>(_scene->secondsPerMeasure());
+	_score = std::make_shared<Score>(_scene->secondsPerMeasure(), _scene->measureStarts());
 	applyAllSettings();
-	return true;
+}
+
+void Renderer::updateLoading() {
+	// Release interrupted loadings once they have stopped, without waiting for them.
+	_cancelledLoadings.erase(std::remove_if(_cancelledLoadings.begin(), _cancelledLoadings.end(), [](const std::future<std::unique_ptr<MIDISceneFile::Content>> & loading){
+		return loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), _cancelledLoadings.end());
+
+	// Create the scene once the file is parsed.
+	if(_loadingContent.valid() && _loadingContent.wait_for(std::chrono::seconds(0)) == std::future_status::ready){
+		try {
+			_loadingScene = std::make_shared<MIDISceneFile>(_loadingContent.get());
+		} catch(...){
+			// Failed to load.
+			std::cerr << "[ERROR]: Unable to load " << _loadingPath << "." << std::endl;
+			if(!_loadingFallbacks.empty()){
+				const std::vector<std::string> fallbacks = _loadingFallbacks;
+				loadFilesAsync(fallbacks);
+				return;
+			}
+			_loadingError = "Unable to load " + _loadingPath + ".";
+			_loadingProgress.reset();
+			return;
+		}
+	}
+	if(!_loadingScene){
+		return;
+	}
+	// Spread the upload over frames to keep the interface responsive.
+	if(!_loadingScene->continueUpload(kUploadNotesPerFrame)){
+		return;
+	}
+	// Sets might have been edited while loading.
+	if(_loadingSetsVersion != _setsVersion){
+		_loadingScene->updateSets(_state.setOptions);
+	}
+	setFileScene(_loadingScene);
+	_loadingScene.reset();
+	_loadingProgress.reset();
+}
+
+void Renderer::cancelLoading() {
+	if(_loadingProgress){
+		_loadingProgress->cancelled = true;
+	}
+	// The loading thread only checks for cancellation between steps, don't block the interface on it.
+	if(_loadingContent.valid()){
+		_cancelledLoadings.push_back(std::move(_loadingContent));
+	}
+	_loadingScene.reset();
+	_loadingProgress.reset();
+	_loadingFallbacks.clear();
+	_loadingError.clear();
 }
 
 bool Renderer::connectDevice(const std::string& deviceName) {
@@ -176,6 +263,7 @@ bool Renderer::connectDevice(const std::string& deviceName) {
 		}
 	}
 
+	cancelLoading();
 	_scene = std::make_shared<MIDISceneLive>(_selectedPort, _verbose);
 	_timer = 0.0f;
 	// Don't start immediately
@@ -183,7 +271,7 @@ bool Renderer::connectDevice(const std::string& deviceName) {
 	_state.reverseScroll = true;
 	_state.scrollSpeed = 1.0f;
 	_liveplay = true;
-	_score = std::make_shared<Score>(_scene->secondsPerMeasure());
+	_score = std::make_shared<Score>(_scene->secondsPerMeasure(), _scene->measureStarts());
 	applyAllSettings();
 
 	return true;
@@ -219,6 +307,8 @@ SystemAction Renderer::draw(float currentTime) {
 
 	// -- Default mode --
 
+	updateLoading();
+
 	// Compute the time elapsed since last frame, or keep the same value if
 	// playback is disabled.
 	_timer = _shouldPlay ? (currentTime - _timerStart) : _timer;
@@ -407,17 +497,18 @@ SystemAction Renderer::drawGUI(const float currentTime) {
 			nfdchar_t *outPath = NULL;
 			nfdresult_t result = NFD_OpenDialog(NULL, NULL, &outPath);
 			if (result == NFD_OKAY) {
-				loadFile(std::string(outPath));
+				loadFileAsync(std::string(outPath));
 			}
 		}
 		ImGuiSameLine(COLUMN_SIZE);
 		if(_liveplay){
 			if (ImGui::Button("Clear and stop session")) {
+				cancelLoading();
 				_scene = std::make_shared<MIDISceneEmpty>();
 				_liveplay = false;
 				_shouldPlay = false;
 				_timer = 0.0f;
-				_score = std::make_shared<Score>(_scene->secondsPerMeasure());
+				_score = std::make_shared<Score>(_scene->secondsPerMeasure(), _scene->measureStarts());
 				applyAllSettings();
 			}
 		} else {
@@ -426,6 +517,7 @@ SystemAction Renderer::drawGUI(const float currentTime) {
 			}
 			showDevices();
 		}
+		showLoading();
 
 		const bool emptyScene = std::dynamic_pointer_cast<MIDISceneEmpty>(_scene) != nullptr;
 		if(!emptyScene)
@@ -545,6 +637,11 @@ SystemAction Renderer::drawGUI(const float currentTime) {
 
 		}
 
+		std::shared_ptr<MIDISceneFile> fileScene = std::dynamic_pointer_cast<MIDISceneFile>(_scene);
+		if(fileScene && fileScene->tracksCount() > 1 && ImGui::CollapsingHeader("Tracks##HEADER")){
+			showTracksOptions(*fileScene);
+		}
+
 		if (_state.showFlashes && ImGui::CollapsingHeader("Flashes##HEADER")) {
 
 			if(channelColorEdit("Color##Flashes", "Color", _state.flashColors)){
@@ -596,6 +693,16 @@ SystemAction Renderer::drawGUI(const float currentTime) {
 			ImGui::TextDisabled("(press D to hide)");
 			ImGui::Text("%.1f FPS / %.1f ms", ImGui::GetIO().Framerate, ImGui::GetIO().DeltaTime * 1000.0f);
 			ImGui::Text("Render size: %dx%d, screen size: %dx%d", _renderFramebuffer->_width, _renderFramebuffer->_height, _camera.screenSize()[0], _camera.screenSize()[1]);
+			if(fileScene){
+				const MIDIStatistics & stats = fileScene->statistics();
+				if(stats.maxPolyphony > 0){
+					ImGui::Text("%d notes over %.1fs, keys %d to %d, up to %d held at once", int(stats.notesCount), stats.duration, int(stats.minKey), int(stats.maxKey), int(stats.maxPolyphony));
+				} else {
+					ImGui::Text("%d notes over %.1fs, keys %d to %d, up to %d held at once in a track", int(stats.notesCount), stats.duration, int(stats.minKey), int(stats.maxKey), int(stats.maxTrackPolyphony));
+				}
+			}
+			const MIDIScene::ParticlesCounters particles = _scene->particlesCounters();
+			ImGui::Text("Particles effects: %d/%d active, %d dropped, %d replaced", int(particles.active), int(particles.capacity), int(particles.dropped), int(particles.stolen));
 			if (ImGui::Button("Print MIDI content to console")) {
 				_scene->print();
 			}
@@ -748,6 +855,16 @@ void Renderer::showParticleOptions(){
 	if (ImGui::SliderInt("Count", &_state.particles.count, 1, 512)) {
 		_state.particles.count = glm::clamp(_state.particles.count, 1, 512);
 	}
+	ImGuiSameLine(COLUMN_SIZE);
+	const bool mp2 = ImGui::InputInt("Effects", &_state.particles.systems, 16, 256);
+	const bool mp3 = ImGui::Combo("When full", (int*)&_state.particles.overflow, "Replace oldest\0Skip\0");
+	if(mp2 || mp3){
+		_state.particles.systems = glm::clamp(_state.particles.systems, 1, 4096);
+		_scene->setParticlesPool(_state.particles.systems, _state.particles.overflow);
+	}
+	if(ImGui::Checkbox("Simulate", &_state.particles.simulated)){
+		_scene->setParticlesSimulation(_state.particles.simulated);
+	}
 
 	ImGui::PopItemWidth();
 
@@ -872,6 +989,34 @@ void Renderer::showPedalOptions(){
 	ImGui::Checkbox("Merge pedals", &_state.pedals.merge);
 }
 
+void Renderer::showTracksOptions(MIDISceneFile & scene){
+	const size_t tracksCount = scene.tracksCount();
+	for(size_t tid = 0; tid < tracksCount; ++tid){
+		ImGui::PushID(int(tid));
+		bool muted = scene.trackMuted(tid);
+		if(ImGui::Checkbox("Mute", &muted)){
+			scene.setTrackMuted(tid, muted);
+		}
+		ImGuiSameLine();
+		bool soloed = scene.trackSoloed(tid);
+		if(ImGui::Checkbox("Solo", &soloed)){
+			scene.setTrackSoloed(tid, soloed);
+		}
+		ImGuiSameLine();
+		// First entry keeps the set of each note.
+		int set = scene.trackSet(tid) + 1;
+		ImGuiPushItemWidth(70);
+		if(ImGui::Combo("Set", &set, "Notes\0 0\0 1\0 2\0 3\0 4\0 5\0 6\0 7\0 8\0 9\0 10\0 11\0\0")){
+			scene.setTrackSet(tid, set - 1);
+		}
+		ImGui::PopItemWidth();
+		ImGuiSameLine();
+		const std::string & name = scene.trackName(tid);
+		ImGui::Text("Track %d%s%s", int(tid), name.empty() ? "" : ": ", name.c_str());
+		ImGui::PopID();
+	}
+}
+
 void Renderer::showWaveOptions(){
 	ImGuiPushItemWidth(25);
 	ImGui::ColorEdit3("Color##Waves", &_state.waves.color[0], ImGuiColorEditFlags_NoInputs);
@@ -1102,12 +1247,13 @@ void Renderer::showDevices(){
 		}
 
 		if(starting){
+			cancelLoading();
 			_timer = 0.0f;
 			_shouldPlay = true;
 			_state.reverseScroll = true;
 			_state.scrollSpeed = 1.0f;
 			_liveplay = true;
-			_score = std::make_shared<Score>(_scene->secondsPerMeasure());
+			_score = std::make_shared<Score>(_scene->secondsPerMeasure(), _scene->measureStarts());
 			applyAllSettings();
 
 			ImGui::CloseCurrentPopup();
@@ -1148,12 +1294,34 @@ void Renderer::showSets(){
 		if(shouldUpdate){
 			_state.setOptions.rebuild();
 			_scene->updateSets(_state.setOptions);
+			++_setsVersion;
 		}
 		ImGui::EndPopup();
 	}
 
 }
 
+void Renderer::showLoading(){
+	if(!_loadingError.empty()){
+		ImGui::TextColored(ImVec4(0.9f, 0.2f, 0.2f, 1.0f), "%s", _loadingError.c_str());
+		ImGuiSameLine(COLUMN_SIZE);
+		if(ImGui::Button("Dismiss")){
+			_loadingError.clear();
+		}
+	}
+	if(!_loadingProgress){
+		return;
+	}
+	// The file is parsed first, then its notes are uploaded.
+	const char * label = _loadingScene ? "Uploading notes..." : "Loading file...";
+	ImGui::ProgressBar(_loadingProgress->value, ImVec2(_guiScale * (COLUMN_SIZE - 20.0f), 0.0f), label);
+	ImGuiSameLine(COLUMN_SIZE);
+	if(ImGui::Button("Cancel loading")){
+		cancelLoading();
+		std::cout << "[INFO]: Loading of " << _loadingPath << " cancelled." << std::endl;
+	}
+}
+
 void Renderer::showSetEditor(){
 
 	const unsigned int colWidth = 80;
@@ -1306,6 +1474,7 @@ void Renderer::showSetEditor(){
 			if(_scene){
 				_scene->updateSets(_state.setOptions);
 			}
+			++_setsVersion;
 		}
 
 		if(_showDebug){
@@ -1377,6 +1546,8 @@ void Renderer::applyAllSettings() {
 	_scene->setScaleAndMinorWidth(_state.scale, _state.background.minorsWidth);
 	_score->setScaleAndMinorWidth(_state.scale, _state.background.minorsWidth);
 	_scene->setParticlesParameters(_state.particles.speed, _state.particles.expansion);
+	_scene->setParticlesPool(_state.particles.systems, _state.particles.overflow);
+	_scene->setParticlesSimulation(_state.particles.simulated);
 	_score->setDisplay(_state.background.digits, _state.background.hLines, _state.background.vLines);
 	_score->setColors(_state.background.linesColor, _state.background.textColor, _state.background.keysColor);
 	_scene->setKeyboardSizeAndFadeout(_state.keyboard.size, _state.notesFadeOut);
@@ -1505,6 +1676,7 @@ void Renderer::setState(const State & state){
 	if(_scene){
 		_scene->updateSets(_state.setOptions);
 	}
+	++_setsVersion;
 	applyAllSettings();
 
 	// Textures.
@@ -5,10 +5,12 @@
 #include <glm/glm.hpp>
 #include <memory>
 #include <array>
+#include <future>
 
 #include "Framebuffer.h"
 #include "camera/Camera.h"
 #include "scene/MIDIScene.h"
+#include "scene/MIDISceneFile.h"
 #include "ScreenQuad.h"
 #include "Score.h"
 
@@ -40,6 +42,12 @@ public:
 	
 	bool loadFile(const std::string & midiFilePath);
 
+	/// Load a file on a background thread, the current scene is displayed until the new one is ready.
+	void loadFileAsync(const std::string & midiFilePath);
+
+	/// Load the first of several files that succeeds, trying them in order on a background thread.
+	void loadFilesAsync(const std::vector<std::string> & midiFilePaths);
+
 	bool connectDevice(const std::string & deviceName);
 
 	void setState(const State & state);
@@ -116,6 +124,8 @@ private:
 
 	void showPedalOptions();
 	
+	void showTracksOptions(MIDISceneFile & scene);
+
 	void showWaveOptions();
 
 	void showBlurOptions();
@@ -134,6 +144,17 @@ private:
 
 	void showSetEditor();
 
+	void showLoading();
+
+	/// Replace the current scene by a loaded file and restart playback.
+	void setFileScene(const std::shared_ptr<MIDISceneFile> & scene);
+
+	/// Continue a background loading, and swap the scene once it is fully uploaded.
+	void updateLoading();
+
+	/// Interrupt a background loading if any, its thread is released once it stops.
+	void cancelLoading();
+
 	void applyBackgroundColor();
 
 	void applyAllSettings();
@@ -193,7 +214,20 @@ private:
 	bool _fullscreen = false;
 	bool _liveplay = false;
 	bool _useTransparency = false;
+	NoteOverlap _noteOverlap = NoteOverlap::RETRIGGER;
+	bool _streamNotes = false;
 	const bool _supportTransparency;
+
+	// Background loading.
+	std::future<std::unique_ptr<MIDISceneFile::Content>> _loadingContent;
+	std::shared_ptr<LoadingProgress> _loadingProgress;
+	std::vector<std::future<std::unique_ptr<MIDISceneFile::Content>>> _cancelledLoadings; ///< Interrupted, kept until their thread stops.
+	std::shared_ptr<MIDISceneFile> _loadingScene; ///< Loaded, uploading its notes.
+	std::string _loadingPath;
+	std::vector<std::string> _loadingFallbacks; ///< Tried in order if the current file fails.
+	std::string _loadingError; ///< Displayed until dismissed or another loading starts.
+	unsigned int _setsVersion = 0; ///< Incremented when sets change, to update a scene loaded in the meantime.
+	unsigned int _loadingSetsVersion = 0;
 };
 
 #endif
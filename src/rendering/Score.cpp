@@ -1,28 +1,102 @@
 #include <stdio.h>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 
 #include "../helpers/ProgramUtilities.h"
 #include "../helpers/ResourcesManager.h"
 
 #include "Score.h"
 
-Score::Score(double secondsPerMeasure){
+// Should match the size of the offsets array in the shader.
+// Covers the minimum scale with one second measures.
+static const long long kMaxMeasures = 256;
+// Extra visible height around the screen, in the same units as MIDIScene.
+static const double kVisibleMargin = 0.05;
+
+Score::Score(double secondsPerMeasure, const std::vector<double> & measureStarts) : _measureStarts(measureStarts), _secondsPerMeasure(secondsPerMeasure) {
 	
 	// Load font atlas.
 	GLuint textureId = ResourcesManager::getTextureFor("font");
 
 	ScreenQuad::init(textureId, "background_frag", "background_vert");
-	
-	// Load additional data.
+	// Updated at each frame.
+	_measureOffsetsId = glGetUniformLocation(_programId, "measureOffsets");
+	_firstMeasureId = glGetUniformLocation(_programId, "firstMeasure");
+	_measuresCountId = glGetUniformLocation(_programId, "measuresCount");
+
+	// At least two increasing starts are needed to extrapolate, else use regular measures.
+	const auto notIncreasing = std::adjacent_find(_measureStarts.begin(), _measureStarts.end(), [](double a, double b){ return b <= a; });
+	if(_measureStarts.size() < 2 || notIncreasing != _measureStarts.end()){
+		_measureStarts.clear();
+	}
+	// Avoid degenerate measures.
+	_secondsPerMeasure = (std::max)(_secondsPerMeasure, 0.001);
+}
+
+double Score::measureStart(long long measure) const {
+	if(_measureStarts.empty()){
+		return double(measure) * _secondsPerMeasure;
+	}
+	const long long count = (long long)(_measureStarts.size());
+	if(measure < 0){
+		return _measureStarts[0] + double(measure) * (_measureStarts[1] - _measureStarts[0]);
+	}
+	if(measure >= count){
+		return _measureStarts[count - 1] + double(measure - count + 1) * (_measureStarts[count - 1] - _measureStarts[count - 2]);
+	}
+	return _measureStarts[measure];
+}
+
+long long Score::measureIndex(double time) const {
+	if(_measureStarts.empty()){
+		return (long long)(std::floor(time / _secondsPerMeasure));
+	}
+	const double first = _measureStarts.front();
+	const double last = _measureStarts.back();
+	if(time < first){
+		return (long long)(std::floor((time - first) / (_measureStarts[1] - first)));
+	}
+	if(time >= last){
+		const long long count = (long long)(_measureStarts.size());
+		return count - 1 + (long long)(std::floor((time - last) / (last - _measureStarts[count - 2])));
+	}
+	return (long long)(std::upper_bound(_measureStarts.begin(), _measureStarts.end(), time) - _measureStarts.begin()) - 1;
+}
+
+void Score::draw(float time, glm::vec2 invScreenSize){
+	// Measures scroll from the top of the keyboard, either up or down, as notes do.
+	const double keyboardTop = 2.0 * double(_keyboardHeight) - 1.0;
+	const double speed = double((std::max)(_scale, 0.001f));
+	const double windowStart = double(time) - ((_reverse ? 1.0 - keyboardTop : 1.0 + keyboardTop) + kVisibleMargin) / speed;
+	const double windowEnd = double(time) + ((_reverse ? 1.0 + keyboardTop : 1.0 - keyboardTop) + kVisibleMargin) / speed;
+	// Keep an extra measure on each side to avoid sudden disappearances.
+	long long first = measureIndex(windowStart) - 1;
+	long long last = measureIndex(windowEnd) + 1;
+	if(last - first + 1 > kMaxMeasures){
+		// Upcoming measures first, past ones are mostly hidden by the keyboard.
+		last = (std::min)(last, measureIndex(double(time)) + kMaxMeasures - 1);
+		first = last - kMaxMeasures + 1;
+	}
+
+	// Offsets are relative to the current time to preserve precision.
+	GLfloat offsets[kMaxMeasures];
+	const int count = int(last - first + 1);
+	for(int i = 0; i < count; ++i){
+		offsets[i] = float(measureStart(first + i) - double(time));
+	}
 	glUseProgram(_programId);
-	GLuint sigID = glGetUniformLocation(_programId, "secondsPerMeasure");
-	glUniform1f(sigID, float(secondsPerMeasure));
+	glUniform1fv(_measureOffsetsId, count, offsets);
+	glUniform1i(_firstMeasureId, int(first));
+	glUniform1i(_measuresCountId, count);
 	glUseProgram(0);
 
+	ScreenQuad::draw(time, invScreenSize);
 }
 
 void Score::setScaleAndMinorWidth(const float scale, const float width){
+	_scale = scale;
 	glUseProgram(_programId);
 	GLuint speedID = glGetUniformLocation(_programId, "mainSpeed");
 	glUniform1f(speedID, scale);
@@ -48,6 +122,7 @@ void Score::setColors(const glm::vec3 & linesColor, const glm::vec3 & textColor,
 }
 
 void Score::setKeyboardSize(float keyboardHeight){
+	_keyboardHeight = keyboardHeight;
 	glUseProgram(_programId);
 	glUniform1f(glGetUniformLocation(_programId, "keyboardHeight"), keyboardHeight);
 	glUseProgram(0);
@@ -61,6 +136,7 @@ void Score::setMinMaxKeys(int minKey, int minKeyMajor, int notesCount){
 }
 
 void Score::setPlayDirection(bool reverse){
+	_reverse = reverse;
 	glUseProgram(_programId);
 	glUniform1i(glGetUniformLocation(_programId, "reverseMode"), reverse ? 1 : 0);
 	glUseProgram(0);
@@ -6,13 +6,17 @@
 
 #include "ScreenQuad.h"
 
+#include <vector>
 
 class Score : public ScreenQuad {
 
 public:
 
-	/// Init function with measure time.
-	Score(double secondsPerMeasure);
+	/// Init function with measure time. If known, the start of each measure can be given, to follow tempo changes.
+	Score(double secondsPerMeasure, const std::vector<double> & measureStarts);
+
+	/// Draw function, placing measures around the current time.
+	void draw(float time, glm::vec2 invScreenSize);
 	
 	void setScaleAndMinorWidth(const float scale, const float width);
 	
@@ -28,6 +32,23 @@ public:
 
 	void setOrientation(bool horizontal);
 
+private:
+
+	/// Start of a measure, extrapolated before the first and after the last known ones.
+	double measureStart(long long measure) const;
+
+	/// Index of the measure containing a given time.
+	long long measureIndex(double time) const;
+
+	std::vector<double> _measureStarts;
+	double _secondsPerMeasure;
+	float _scale = 1.0f;
+	float _keyboardHeight = 0.25f;
+	bool _reverse = false;
+	GLint _measureOffsetsId = -1;
+	GLint _firstMeasureId = -1;
+	GLint _measuresCountId = -1;
+
 };
 
 #endif
@@ -5,33 +5,100 @@
 #include <algorithm>
 #include <glm/glm.hpp>
 #include <sstream>
+#include <limits>
 
 SetOptions::SetOptions(){
 	rebuild();
 }
 
+// Key of sets without key frames, no note is below it.
+static const int kNoThreshold = std::numeric_limits<int>::min();
+
 void SetOptions::rebuild(){
 	// Reset
 	_firstNonEmptySet = SETS_COUNT;
 	_lastNonEmptySet = -1;
+	std::array<KeyFrames, SETS_COUNT> keysPerSet;
 	for(unsigned int sid = 0; sid < SETS_COUNT; ++sid){
-		_keysPerSet[sid].clear();
-		_keysPerSet[sid].reserve(keys.size());
+		keysPerSet[sid].reserve(keys.size());
 	}
 
 	// Sort reference keys.
 	std::sort(keys.begin(), keys.end());
 
+	_segmentsStart.clear();
 	for(const KeyFrame& key : keys){
 		// Insert in subset, they are already sorted.
-		_keysPerSet[key.set].push_back(key);
+		keysPerSet[key.set].push_back(key);
 		// Keep track of bounds.
 		_firstNonEmptySet = (std::min)(_firstNonEmptySet, key.set);
 		_lastNonEmptySet  = (std::max)( _lastNonEmptySet, key.set);
+		// Each key frame starts a new segment.
+		if(_segmentsStart.empty() || _segmentsStart.back() < key.time){
+			_segmentsStart.push_back(key.time);
+		}
+	}
+
+	// Before its first key frame, a set uses the key of that frame.
+	// Then each set uses the key of its last frame starting at or before the segment start.
+	const size_t segmentsCount = _segmentsStart.size() + 1;
+	_segmentsThresholds.resize(segmentsCount);
+	_segmentsSets.resize(segmentsCount);
+	std::array<size_t, SETS_COUNT> currentKeys;
+	currentKeys.fill(0);
+	for(size_t segment = 0; segment < segmentsCount; ++segment){
+		Thresholds & thresholds = _segmentsThresholds[segment];
+		for(unsigned int sid = 0; sid < SETS_COUNT; ++sid){
+			const KeyFrames & setKeys = keysPerSet[sid];
+			if(setKeys.empty()){
+				thresholds[sid] = kNoThreshold;
+				continue;
+			}
+			if(segment > 0){
+				while(currentKeys[sid] + 1 < setKeys.size() && setKeys[currentKeys[sid] + 1].time <= _segmentsStart[segment - 1]){
+					++currentKeys[sid];
+				}
+			}
+			thresholds[sid] = setKeys[currentKeys[sid]].key;
+		}
+		for(int note = 0; note < 128; ++note){
+			_segmentsSets[segment][note] = uint8_t(listSet(note, thresholds));
+		}
 	}
 }
 
+int SetOptions::listSet(int note, const Thresholds & thresholds) const {
+	int sid = _firstNonEmptySet;
+	for(; sid <= _lastNonEmptySet; ++sid){
+		if(thresholds[sid] != kNoThreshold && note < thresholds[sid]){
+			break;
+		}
+	}
+	return glm::clamp(sid, _firstNonEmptySet, _lastNonEmptySet + 1) % SETS_COUNT;
+}
+
+int SetOptions::listSet(int note, size_t segment) const {
+	if(note >= 0 && note < 128){
+		return _segmentsSets[segment][note];
+	}
+	return listSet(note, _segmentsThresholds[segment]);
+}
+
+size_t SetOptions::segmentIndex(double start) const {
+	// Number of segment starts at or before the time.
+	const auto next = std::upper_bound(_segmentsStart.begin(), _segmentsStart.end(), start);
+	return size_t(std::distance(_segmentsStart.begin(), next));
+}
+
 int SetOptions::apply(int note, int channel, int track, double start) const {
+	if(mode == SetMode::LIST){
+		return listSet(note, segmentIndex(start));
+	}
+	Cursor cursor;
+	return apply(note, channel, track, start, cursor);
+}
+
+int SetOptions::apply(int note, int channel, int track, double start, Cursor & cursor) const {
 	switch(mode){
 		case SetMode::CHANNEL:
 			return channel % SETS_COUNT;
@@ -43,29 +110,16 @@ int SetOptions::apply(int note, int channel, int track, double start) const {
 			return (note % 12) % SETS_COUNT;
 		case SetMode::LIST:
 		{
-			// For each channel, find the corresponding key, and test
-			int sid = _firstNonEmptySet;
-			for(; sid <= _lastNonEmptySet; ++sid){
-				const int keyCount = int(_keysPerSet[sid].size());
-				if(keyCount == 0){
-					// Ignore this set.
-					continue;
+			const size_t count = _segmentsStart.size();
+			if(cursor.segment > count || (cursor.segment > 0 && start < _segmentsStart[cursor.segment - 1])){
+				// Going backward, restart from scratch.
+				cursor.segment = segmentIndex(start);
+			} else {
+				while(cursor.segment < count && _segmentsStart[cursor.segment] <= start){
+					++cursor.segment;
 				}
-				// TODO: binary search instead.
-				int kid = 0;
-				for( ; kid < keyCount; ++kid){
-					if(start < _keysPerSet[sid][kid].time){
-						// We found the key after.
-						break;
-					}
-				}
-				kid = (std::max)(0, kid - 1);
-				if(note < _keysPerSet[sid][kid].key){
-					break;
-				}
-
 			}
-			return glm::clamp(sid, _firstNonEmptySet, _lastNonEmptySet + 1) % SETS_COUNT;
+			return listSet(note, cursor.segment);
 		}
 		default:
 			assert(false);
@@ -4,6 +4,7 @@
 #include <vector>
 #include <array>
 #include <string>
+#include <cstdint>
 
 #define SETS_COUNT 12
 
@@ -31,19 +32,41 @@ struct SetOptions {
 	std::vector<KeyFrame> keys;
 	int key = 64;
 
+	/// Position of the last lookup, to speed up assignment of notes sorted by start.
+	struct Cursor {
+		size_t segment = 0;
+	};
+
 	SetOptions();
 	
+	/// Sort keys and precompute the set of each key between consecutive key frames, for the list mode.
 	void rebuild();
 
 	int apply(int note, int channel, int track, double start) const;
 
+	/// Same, starting the search from the cursor. Amortized constant time for increasing starts.
+	int apply(int note, int channel, int track, double start, Cursor & cursor) const;
+
 	std::string toKeysString(const std::string& separator) const;
 
 	void fromKeysString(const std::string& str);
 
 private:
 
-	std::array<KeyFrames, SETS_COUNT> _keysPerSet;
+	using Thresholds = std::array<int, SETS_COUNT>;
+
+	/// In list mode, a note belongs to the first set with a key above it.
+	int listSet(int note, const Thresholds & thresholds) const;
+
+	int listSet(int note, size_t segment) const;
+
+	size_t segmentIndex(double start) const;
+
+	/// Key frames times, splitting time in segments where the key of each set is constant.
+	std::vector<double> _segmentsStart;
+	/// For each segment (one more than starts), key of each set, and set of each note.
+	std::vector<Thresholds> _segmentsThresholds;
+	std::vector<std::array<uint8_t, 128>> _segmentsSets;
 	int _firstNonEmptySet = SETS_COUNT;
 	int _lastNonEmptySet = -1;
 };
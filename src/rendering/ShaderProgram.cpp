@@ -0,0 +1,59 @@
+#include "../helpers/ProgramUtilities.h"
+#include "../helpers/ResourcesManager.h"
+
+#include "ShaderProgram.h"
+
+void ShaderProgram::init(const std::string & vertName, const std::string & fragName, const std::vector<std::string> & feedbackOutputs){
+	const std::string fragContent = fragName.empty() ? "" : ResourcesManager::getStringForShader(fragName);
+	_id = createGLProgramFromStrings(ResourcesManager::getStringForShader(vertName), fragContent, "", feedbackOutputs);
+	_uniforms.clear();
+	if(_id == 0){
+		return;
+	}
+	GLint count = 0;
+	GLint maxLength = 0;
+	glGetProgramiv(_id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> buffer(size_t(maxLength) + 1);
+	for(GLint uid = 0; uid < count; ++uid){
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = GL_NONE;
+		glGetActiveUniform(_id, GLuint(uid), GLsizei(buffer.size()), &length, &size, &type, buffer.data());
+		std::string name(buffer.data(), size_t(length));
+		// Members of uniform blocks have no location.
+		const GLint location = glGetUniformLocation(_id, name.c_str());
+		if(location < 0){
+			continue;
+		}
+		// Arrays are reported as their first element.
+		const std::string::size_type bracket = name.find('[');
+		if(bracket != std::string::npos){
+			name = name.substr(0, bracket);
+		}
+		_uniforms[name] = location;
+	}
+	checkGLError();
+}
+
+void ShaderProgram::use() const {
+	glUseProgram(_id);
+}
+
+GLint ShaderProgram::uniform(const std::string & name) const {
+	const auto location = _uniforms.find(name);
+	return location != _uniforms.end() ? location->second : -1;
+}
+
+void ShaderProgram::bindBlock(const std::string & name, GLuint binding) const {
+	const GLuint index = glGetUniformBlockIndex(_id, name.c_str());
+	if(index != GL_INVALID_INDEX){
+		glUniformBlockBinding(_id, index, binding);
+	}
+}
+
+void ShaderProgram::clean(){
+	glDeleteProgram(_id);
+	_id = 0;
+	_uniforms.clear();
+}
@@ -0,0 +1,40 @@
+#ifndef ShaderProgram_h
+#define ShaderProgram_h
+#include <gl3w/gl3w.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/// OpenGL program whose uniform locations are queried once after linking.
+class ShaderProgram {
+
+public:
+
+	/// Create the program from shaders resources and query its uniforms.
+	/// If outputs to capture with transform feedback are given, the fragment shader can be omitted.
+	void init(const std::string & vertName, const std::string & fragName, const std::vector<std::string> & feedbackOutputs = std::vector<std::string>());
+
+	/// Bind the program for rendering.
+	void use() const;
+
+	/// Location of a uniform, arrays can be referred to by their name only.
+	/// \return the location, or -1 if the uniform is not used by the program (ignored by glUniform calls)
+	GLint uniform(const std::string & name) const;
+
+	/// Connect a uniform block of the program to a buffer binding point, if the block is used.
+	void bindBlock(const std::string & name, GLuint binding) const;
+
+	/// Clean function
+	void clean();
+
+	GLuint id() const { return _id; }
+
+private:
+
+	GLuint _id = 0;
+	std::unordered_map<std::string, GLint> _uniforms;
+
+};
+
+#endif
@@ -83,9 +83,11 @@ State::OptionInfos::OptionInfos(const std::string & adesc, State::OptionInfos::T
 void State::defineOptions(){
 	// Integers.
 	_sharedInfos["particles-count"] = {"Particles count", OptionInfos::Type::INTEGER, {1.0f, 512.0f}};
+	_sharedInfos["particles-systems"] = {"Maximum number of particles effects displayed at once", OptionInfos::Type::INTEGER, {1.0f, 4096.0f}};
 
 	// Booleans.
 	_sharedInfos["show-particles"] = {"Should particles be shown", OptionInfos::Type::BOOLEAN};
+	_sharedInfos["particles-simulation"] = {"Should particles be simulated on the GPU, allowing many more of them at once", OptionInfos::Type::BOOLEAN};
 	_sharedInfos["show-flashes"] = {"Should flashes be shown", OptionInfos::Type::BOOLEAN};
 	_sharedInfos["show-blur"] = {"Should the blur be visible", OptionInfos::Type::BOOLEAN};
 	_sharedInfos["show-blur-notes"] = {"Should the notes be part of the blur", OptionInfos::Type::BOOLEAN};
@@ -129,6 +131,8 @@ void State::defineOptions(){
 	// Others.
 	_sharedInfos["quality"] = {"Rendering quality", OptionInfos::Type::OTHER};
 	_sharedInfos["quality"].values = "values: LOW_RES, LOW, MEDIUM, HIGH, HIGH_RES";
+	_sharedInfos["particles-overflow"] = {"What to do with the particles of new notes when all effects are displayed", OptionInfos::Type::OTHER, {0.0f, 1.0f}};
+	_sharedInfos["particles-overflow"].values = "replace-oldest: 0, skip: 1";
 	_sharedInfos["layers"] = {"Active layers indices, from background to foreground", OptionInfos::Type::OTHER};
 	_sharedInfos["layers"].values = "values: bg-color: 0, bg-texture: 1, blur: 2, score: 3, keyboard: 4, particles: 5, notes: 6, flashes: 7, pedal: 8, wave: 9";
 	_sharedInfos["sets-separator-control-points"] = {"Sets of control points for dynamic set asignment", OptionInfos::Type::OTHER};
@@ -228,7 +232,10 @@ void State::updateOptions(){
 	}
 
 	_intInfos["particles-count"] = &particles.count;
+	_intInfos["particles-systems"] = &particles.systems;
+	_intInfos["particles-overflow"] = (int*)&particles.overflow;
 	_boolInfos["show-particles"] = &showParticles;
+	_boolInfos["particles-simulation"] = &particles.simulated;
 	_boolInfos["show-flashes"] = &showFlashes;
 	_boolInfos["show-blur"] = &showBlur;
 	_boolInfos["show-blur-notes"] = &showBlurNotes;
@@ -582,6 +589,9 @@ void State::reset(){
 	particles.expansion = 1.0f;
 	particles.scale = 1.0f;
 	particles.count = 256;
+	particles.systems = 256;
+	particles.overflow = ParticlesState::Overflow::STEAL_OLDEST;
+	particles.simulated = false;
 	particles.imagePaths = "";
 	const GLuint blankID = ResourcesManager::getTextureFor("blankarray");
 	particles.tex = blankID;
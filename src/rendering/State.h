@@ -64,6 +64,11 @@ public:
 	
 	
 	struct ParticlesState {
+
+		enum Overflow : int {
+			STEAL_OLDEST = 0, SKIP = 1
+		};
+
 		std::string imagePaths; ///< List of paths to images on disk.
 		ColorArray colors; ///< Particles color.
 		GLuint tex;
@@ -72,6 +77,9 @@ public:
 		float expansion; ///< Expansion factor.
 		float scale; ///< Particles scale.
 		int count; ///< Number of particles.
+		int systems; ///< Maximum number of particles systems active at once.
+		Overflow overflow; ///< What to do with new notes when all systems are active.
+		bool simulated; ///< Simulate particles over time instead of following precomputed trajectories.
 	};
 
 	struct KeyboardState {
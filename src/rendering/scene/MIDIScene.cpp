@@ -2,6 +2,8 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <limits>
+#include <cstddef>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "../../helpers/ProgramUtilities.h"
@@ -16,6 +18,21 @@
 #undef MAX
 #endif
 
+// Notes sorted by start are culled by blocks of this size.
+static const int kNotesBlockSize = 256;
+// Extra screen space around the visible notes, in normalized coordinates.
+static const float kVisibleMargin = 0.05f;
+// Visible parts of contiguous ranges separated by at most this many notes are drawn at once.
+static const int kMergeGap = 1024;
+// Uniform buffer binding point of the values shared by all programs.
+static const GLuint kSceneDataBinding = 0;
+// Default size of the particles systems pool.
+static const int kParticlesSystemsCount = 256;
+// Number of simulated particles, alive or not.
+static const size_t kSimulatedParticlesCount = 1 << 16;
+// Longer simulation steps are considered as jumps in time, and restart the simulation.
+static const float kSimulationMaxStep = 0.5f;
+
 MIDIScene::~MIDIScene(){}
 
 MIDIScene::MIDIScene(){
@@ -49,7 +66,7 @@ void MIDIScene::renderSetup(){
 	// Programs.
 
 	// Notes shaders.
-	_programId = createGLProgramFromStrings(ResourcesManager::getStringForShader("notes_vert"), ResourcesManager::getStringForShader("notes_frag"));
+	_programNotes.init("notes_vert", "notes_frag");
 
 	// Generate a vertex array (useful when we add other attributes to the geometry).
 	_vao = 0;
@@ -82,7 +99,7 @@ void MIDIScene::renderSetup(){
 	checkGLError();
 
 	// Flashes shaders.
-	_programFlashesId = createGLProgramFromStrings(ResourcesManager::getStringForShader("flashes_vert"), ResourcesManager::getStringForShader("flashes_frag"));
+	_programFlashes.init("flashes_vert", "flashes_frag");
 
 	glGenVertexArrays (1, &_vaoFlashes);
 	glBindVertexArray(_vaoFlashes);
@@ -101,16 +118,15 @@ void MIDIScene::renderSetup(){
 
 	// Flash texture loading.
 	_texFlash = ResourcesManager::getTextureFor("flash");
-	glUseProgram(_programFlashesId);
+	_programFlashes.use();
 	glActiveTexture(GL_TEXTURE0);
-	GLuint texUniID = glGetUniformLocation(_programFlashesId, "textureFlash");
-	glUniform1i(texUniID, 0);
+	glUniform1i(_programFlashes.uniform("textureFlash"), 0);
 	glUseProgram(0);
 
 
 	// Particles program.
 
-	_programParticulesId = createGLProgramFromStrings(ResourcesManager::getStringForShader("particles_vert"), ResourcesManager::getStringForShader("particles_frag"));
+	_programParticles.init("particles_vert", "particles_frag");
 
 	glGenVertexArrays (1, &_vaoParticles);
 	glBindVertexArray(_vaoParticles);
@@ -119,28 +135,65 @@ void MIDIScene::renderSetup(){
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 	glVertexAttribDivisor(0, 0);
+	// The second attribute will be the parameters of each particles system, shared by its particles.
+	// The buffer is allocated with the pool.
+	glGenBuffers(1, &_systemsBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _systemsBuffer);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, NULL);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
 
 	// Particles trajectories texture loading.
 	_texParticles = ResourcesManager::getTextureFor("particles");
-	glUseProgram(_programParticulesId);
+	_programParticles.use();
 	glActiveTexture(GL_TEXTURE0);
-	GLuint texUniID1 = glGetUniformLocation(_programParticulesId, "textureParticles");
-	glUniform1i(texUniID1, 0);
-
-	glUseProgram(_programParticulesId);
+	glUniform1i(_programParticles.uniform("textureParticles"), 0);
 	glActiveTexture(GL_TEXTURE1);
-	GLuint texUniID2 = glGetUniformLocation(_programParticulesId, "lookParticles");
-	glUniform1i(texUniID2, 1);
+	glUniform1i(_programParticles.uniform("lookParticles"), 1);
 
 	// Pass texture size to shader.
 	const glm::vec2 tsize = ResourcesManager::getTextureSizeFor("particles");
-	GLuint texSizeID = glGetUniformLocation(_programParticulesId, "inverseTextureSize");
-	glUniform2f(texSizeID, 1.0f/float(tsize[0]), 1.0f/float(tsize[1]));
+	glUniform2f(_programParticles.uniform("inverseTextureSize"), 1.0f/float(tsize[0]), 1.0f/float(tsize[1]));
 	glUseProgram(0);
 
+	// Simulated particles programs, the update only captures its outputs.
+	_programParticlesUpdate.init("particlesupdate_vert", "", { "outState", "outInfos" });
+	_programParticlesSimulated.init("particlessimulated_vert", "particles_frag");
+	_programParticlesSimulated.use();
+	glUniform1i(_programParticlesSimulated.uniform("lookParticles"), 1);
+	glUseProgram(0);
+	// The buffers are allocated when the simulation is enabled.
+	glGenBuffers(2, &_simulationBuffers[0]);
+	glGenVertexArrays(2, &_vaoSimulationUpdate[0]);
+	glGenVertexArrays(2, &_vaoSimulationDraw[0]);
+	for(size_t bid = 0; bid < 2; ++bid){
+		// Particles as points.
+		glBindVertexArray(_vaoSimulationUpdate[bid]);
+		glBindBuffer(GL_ARRAY_BUFFER, _simulationBuffers[bid]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SimulatedParticle), (void*)offsetof(SimulatedParticle, state));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SimulatedParticle), (void*)offsetof(SimulatedParticle, infos));
+		// Particles as instanced quads.
+		glBindVertexArray(_vaoSimulationDraw[bid]);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+		glVertexAttribDivisor(0, 0);
+		glBindBuffer(GL_ARRAY_BUFFER, _simulationBuffers[bid]);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SimulatedParticle), (void*)offsetof(SimulatedParticle, state));
+		glVertexAttribDivisor(1, 1);
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(SimulatedParticle), (void*)offsetof(SimulatedParticle, infos));
+		glVertexAttribDivisor(2, 1);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
 	// Keyboard setup.
-	_programKeysId = createGLProgramFromStrings(ResourcesManager::getStringForShader("keys_vert"), ResourcesManager::getStringForShader("keys_frag"));
+	_programKeys.init("keys_vert", "keys_frag");
 	glGenVertexArrays(1, &_vaoKeyboard);
 	glBindVertexArray(_vaoKeyboard);
 	// The first attribute will be the vertices positions.
@@ -153,7 +206,7 @@ void MIDIScene::renderSetup(){
 	glBindVertexArray(0);
 
 	// Pedals setup.
-	_programPedalsId = createGLProgramFromStrings(ResourcesManager::getStringForShader("pedal_vert"), ResourcesManager::getStringForShader("pedal_frag"));
+	_programPedals.init("pedal_vert", "pedal_frag");
 	// Create an array buffer to host the geometry data.
 	GLuint vboPdl = 0;
 	glGenBuffers(1, &vboPdl);
@@ -173,7 +226,7 @@ void MIDIScene::renderSetup(){
 	_countPedals = pedalsIndices.size();
 
 	// Wave setup.
-	_programWaveId = createGLProgramFromStrings(ResourcesManager::getStringForShader("wave_vert"), ResourcesManager::getStringForShader("wave_frag"));
+	_programWave.init("wave_vert", "wave_frag");
 	// Create an array buffer to host the geometry data.
 	const int numSegments = 512;
 	std::vector<glm::vec2> waveVerts((numSegments+1)*2);
@@ -210,46 +263,80 @@ void MIDIScene::renderSetup(){
 	glBindVertexArray(0);
 	_countWave = waveInds.size();
 
+	// Values shared by all programs.
+	glGenBuffers(1, &_sceneBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, _sceneBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(SceneData), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	for(const ShaderProgram * program : { &_programNotes, &_programFlashes, &_programParticles, &_programParticlesSimulated, &_programKeys, &_programWave }){
+		program->bindBlock("SceneData", kSceneDataBinding);
+	}
+	_sceneDataDirty = true;
+
 	// Prepare actives notes array.
 	_actives.fill(-1);
 	// Particle systems pool.
-	_particles = std::vector<Particles>(256);
+	setParticlesPool(kParticlesSystemsCount, _particlesOverflow);
 }
 
 void MIDIScene::setScaleAndMinorWidth(const float scale, const float minorWidth){
-	glUseProgram(_programId);
-	GLuint speedID = glGetUniformLocation(_programId, "mainSpeed");
-	glUniform1f(speedID, scale);
-	GLuint widthId = glGetUniformLocation(_programId, "minorsWidth");
-	glUniform1f(widthId, minorWidth);
-	glUseProgram(_programKeysId);
-	GLuint widthId1 = glGetUniformLocation(_programKeysId, "minorsWidth");
-	glUniform1f(widthId1, minorWidth);
+	_scale = scale;
+	_programNotes.use();
+	glUniform1f(_programNotes.uniform("mainSpeed"), scale);
 	glUseProgram(0);
+	_sceneData.minorsWidth = minorWidth;
+	_sceneDataDirty = true;
 }
 
 void MIDIScene::setParticlesParameters(const float speed, const float expansion){
-	glUseProgram(_programParticulesId);
-	GLuint id0 = glGetUniformLocation(_programParticulesId, "speedScaling");
-	glUniform1f(id0, speed);
-	GLuint id1 = glGetUniformLocation(_programParticulesId, "expansionFactor");
-	glUniform1f(id1, expansion);
+	_programParticles.use();
+	glUniform1f(_programParticles.uniform("speedScaling"), speed);
+	glUniform1f(_programParticles.uniform("expansionFactor"), expansion);
+	_programParticlesUpdate.use();
+	glUniform1f(_programParticlesUpdate.uniform("speedScaling"), speed);
+	glUniform1f(_programParticlesUpdate.uniform("expansionFactor"), expansion);
 	glUseProgram(0);
 }
 
 void MIDIScene::setKeyboardSizeAndFadeout(float keyboardHeight, float fadeOut){
 	const float fadeOutFinal = keyboardHeight + (1.0f - keyboardHeight) * (1.0f - fadeOut);
-
-	glUseProgram(_programId);
-	glUniform1f(glGetUniformLocation(_programId, "keyboardHeight"), keyboardHeight);
-	glUniform1f(glGetUniformLocation(_programId, "fadeOut"), fadeOutFinal);
-	glUseProgram(_programParticulesId);
-	glUniform1f(glGetUniformLocation(_programParticulesId, "keyboardHeight"), keyboardHeight);
-	glUseProgram(_programKeysId);
-	glUniform1f(glGetUniformLocation(_programKeysId, "keyboardHeight"), keyboardHeight);
-	glUseProgram(_programFlashesId);
-	glUniform1f(glGetUniformLocation(_programFlashesId, "keyboardHeight"), keyboardHeight);
+	_programNotes.use();
+	glUniform1f(_programNotes.uniform("fadeOut"), fadeOutFinal);
 	glUseProgram(0);
+	_sceneData.keyboardHeight = keyboardHeight;
+	_sceneDataDirty = true;
+}
+
+void MIDIScene::setPassData(const glm::vec2 & invScreenSize){
+	if(_sceneData.inverseScreenSize != invScreenSize){
+		_sceneData.inverseScreenSize = invScreenSize;
+		_sceneDataDirty = true;
+	}
+}
+
+void MIDIScene::setPassData(const glm::vec2 & invScreenSize, const ColorArray & majorColors, const ColorArray & minorColors){
+	setPassData(invScreenSize);
+	for(size_t cid = 0; cid < SETS_COUNT; ++cid){
+		const glm::vec4 majorColor(majorColors[cid], 1.0f);
+		const glm::vec4 minorColor(minorColors[cid], 1.0f);
+		if(_sceneData.majorColors[cid] != majorColor || _sceneData.minorColors[cid] != minorColor){
+			_sceneData.majorColors[cid] = majorColor;
+			_sceneData.minorColors[cid] = minorColor;
+			_sceneDataDirty = true;
+		}
+	}
+}
+
+void MIDIScene::bindSceneData(){
+	static_assert(sizeof(SceneData) == 26 * sizeof(glm::vec4), "SceneData should follow the std140 layout of the block.");
+	if(_sceneDataDirty){
+		glBindBuffer(GL_UNIFORM_BUFFER, _sceneBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SceneData), &_sceneData);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		_sceneDataDirty = false;
+	}
+	// Other scenes might share the binding point.
+	glBindBufferBase(GL_UNIFORM_BUFFER, kSceneDataBinding, _sceneBuffer);
 }
 
 void MIDIScene::resetParticles() {
@@ -258,52 +345,232 @@ void MIDIScene::resetParticles() {
 		particle.set = -1;
 		particle.duration = particle.start = particle.elapsed = 0.0f;
 	}
+	// All systems are free, the first ones will be used first.
+	_particlesActive.clear();
+	_particlesFree.resize(_particles.size());
+	for(size_t pid = 0; pid < _particlesFree.size(); ++pid){
+		_particlesFree[pid] = int(_particlesFree.size() - 1 - pid);
+	}
+	_simulationEmitted.clear();
+	_simulationReset = true;
+}
+
+void MIDIScene::setParticlesPool(int capacity, State::ParticlesState::Overflow overflow){
+	_particlesOverflow = overflow;
+	const size_t newCapacity = size_t((std::max)(capacity, 1));
+	if(newCapacity == _particles.size()){
+		return;
+	}
+	_particles.resize(newCapacity);
+	_particlesFree.reserve(newCapacity);
+	_systemsData.reserve(newCapacity);
+	resetParticles();
+	glBindBuffer(GL_ARRAY_BUFFER, _systemsBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec4) * newCapacity, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MIDIScene::setParticlesSimulation(bool enabled){
+	if(enabled == _particlesSimulated){
+		return;
+	}
+	_particlesSimulated = enabled;
+	if(enabled && !_simulationAllocated){
+		for(const GLuint buffer : _simulationBuffers){
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(SimulatedParticle) * kSimulatedParticlesCount, nullptr, GL_DYNAMIC_COPY);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		_simulationAllocated = true;
+	}
+	resetParticles();
+}
+
+MIDIScene::ParticlesCounters MIDIScene::particlesCounters() const {
+	ParticlesCounters counters;
+	counters.active = _particlesActive.size();
+	counters.capacity = _particles.size();
+	counters.dropped = _particlesDropped;
+	counters.stolen = _particlesStolen;
+	return counters;
+}
+
+void MIDIScene::updateParticles(double time, double speed){
+	_particlesTime = time;
+	_particlesSpeed = speed;
+	// Without recent steps, for instance when particles are hidden, the simulation will restart
+	// and notes emitted since the last step are outdated.
+	if(_particlesSimulated){
+		const double elapsed = (time - _simulationTime) / speed;
+		if(_simulationReset || elapsed < 0.0 || elapsed > double(kSimulationMaxStep)){
+			_simulationReset = true;
+			_simulationEmitted.clear();
+		}
+	}
+	// Compact the active systems in place to keep them sorted by start.
+	size_t kept = 0;
+	for(size_t aid = 0; aid < _particlesActive.size(); ++aid){
+		const int pid = _particlesActive[aid];
+		Particles & particle = _particles[pid];
+		// Give a bit of a head start to the animation.
+		particle.elapsed = (float(time) - particle.start + 0.25f) / (float(speed) * particle.duration);
+		// Release particles that shouldn't be visible at the current time.
+		if(float(time) >= particle.start + particle.duration || float(time) < particle.start){
+			particle.note = -1;
+			particle.set = -1;
+			particle.duration = particle.start = particle.elapsed = 0.0f;
+			_particlesFree.push_back(pid);
+			continue;
+		}
+		_particlesActive[kept++] = pid;
+	}
+	_particlesActive.resize(kept);
+}
+
+void MIDIScene::emitParticles(int note, int set, float start, float duration){
+	// Simulated particles are spawned at the next step, in their own buffer.
+	if(_particlesSimulated){
+		Particles emitted;
+		emitted.note = note;
+		emitted.set = set;
+		emitted.start = start;
+		emitted.duration = duration;
+		_simulationEmitted.push_back(emitted);
+		return;
+	}
+	int pid = -1;
+	if(!_particlesFree.empty()){
+		pid = _particlesFree.back();
+		_particlesFree.pop_back();
+	} else if(_particlesOverflow == State::ParticlesState::Overflow::STEAL_OLDEST && !_particlesActive.empty()){
+		// Only when the pool is full: reuse the system that started first.
+		pid = _particlesActive.front();
+		_particlesActive.pop_front();
+		++_particlesStolen;
+	} else {
+		++_particlesDropped;
+		return;
+	}
+	Particles & particle = _particles[pid];
+	particle.duration = duration;
+	particle.start = start;
+	particle.note = note;
+	particle.set = set;
+	particle.elapsed = 0.0f;
+	// Notes mostly start in order, the system is almost always inserted last.
+	auto position = _particlesActive.end();
+	while(position != _particlesActive.begin() && _particles[*(position - 1)].start > start){
+		--position;
+	}
+	_particlesActive.insert(position, pid);
+}
+
+void MIDIScene::simulateParticles(int particlesPerNote){
+	float deltaTime = float((_particlesTime - _simulationTime) / _particlesSpeed);
+	_simulationTime = _particlesTime;
+
+	// Jumping in time restarts the simulation with no particles.
+	if(_simulationReset || deltaTime < 0.0f || deltaTime > kSimulationMaxStep){
+		const std::vector<SimulatedParticle> deadParticles(kSimulatedParticlesCount);
+		for(const GLuint buffer : _simulationBuffers){
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(SimulatedParticle) * kSimulatedParticlesCount, &(deadParticles[0]));
+		}
+		_simulationHead = 0;
+		_simulationCount = 0;
+		_simulationReset = false;
+		// Only initialize the new particles.
+		deltaTime = 0.0f;
+	}
+
+	// New particles replace the oldest ones, they will be initialized by the update.
+	_simulationSpawns.clear();
+	for(const Particles & emitted : _simulationEmitted){
+		SimulatedParticle particle;
+		particle.infos = glm::vec4(float(emitted.note), -1.0f, float(emitted.set), emitted.duration);
+		_simulationSpawns.insert(_simulationSpawns.end(), size_t((std::max)(particlesPerNote, 0)), particle);
+	}
+	_simulationEmitted.clear();
+	glBindBuffer(GL_ARRAY_BUFFER, _simulationBuffers[_simulationCurrent]);
+	size_t first = _simulationSpawns.size() > kSimulatedParticlesCount ? (_simulationSpawns.size() - kSimulatedParticlesCount) : 0;
+	while(first < _simulationSpawns.size()){
+		const size_t count = (std::min)(_simulationSpawns.size() - first, kSimulatedParticlesCount - _simulationHead);
+		glBufferSubData(GL_ARRAY_BUFFER, _simulationHead * sizeof(SimulatedParticle), count * sizeof(SimulatedParticle), &(_simulationSpawns[first]));
+		first += count;
+		_simulationHead = (_simulationHead + count) % kSimulatedParticlesCount;
+		_simulationCount = (std::min)(_simulationCount + count, kSimulatedParticlesCount);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Advance all spawned particles, the result is captured in the other buffer.
+	const size_t next = 1 - _simulationCurrent;
+	_programParticlesUpdate.use();
+	glUniform1f(_programParticlesUpdate.uniform("deltaTime"), deltaTime);
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(_vaoSimulationUpdate[_simulationCurrent]);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, _simulationBuffers[next]);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, GLsizei(_simulationCount));
+	glEndTransformFeedback();
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+	glUseProgram(0);
+	_simulationCurrent = next;
 }
 
 void MIDIScene::drawParticles(float time, const glm::vec2 & invScreenSize, const State::ParticlesState & state, bool prepass){
 
+	// Simulated particles are advanced once per frame, both passes show the same state.
+	if(_particlesSimulated && (_simulationReset || _simulationTime != _particlesTime)){
+		simulateParticles(state.count);
+	}
+
 	glEnable(GL_BLEND);
-	glUseProgram(_programParticulesId);
-	
-	// Common uniforms values.
-	GLuint screenId = glGetUniformLocation(_programParticulesId, "inverseScreenSize");
-	GLuint timeId = glGetUniformLocation(_programParticulesId, "time");
-	GLuint durationId = glGetUniformLocation(_programParticulesId, "duration");
-	glUniform2fv(screenId,1, &(invScreenSize[0]));
-	glUniform1f(timeId,0.0);
-
-	// Variable uniforms.
-	GLuint globalShiftId = glGetUniformLocation(_programParticulesId, "globalId");
-	GLuint scaleId = glGetUniformLocation(_programParticulesId, "scale");
-	GLuint colorId = glGetUniformLocation(_programParticulesId, "baseColor");
-	GLuint channelId = glGetUniformLocation(_programParticulesId, "channel");
+	setPassData(invScreenSize);
+	bindSceneData();
+	const ShaderProgram & program = _particlesSimulated ? _programParticlesSimulated : _programParticles;
+	program.use();
 	
 	// Prepass : bigger, darker particles.
-	GLuint colorScaleId = glGetUniformLocation(_programParticulesId, "colorScale");
-	glUniform1f(colorScaleId, prepass ? 0.6f : 1.6f);
-	glUniform1f(scaleId, state.scale * (prepass ? 2.0f : 1.0f));
+	glUniform1f(program.uniform("colorScale"), prepass ? 0.6f : 1.6f);
+	glUniform1f(program.uniform("scale"), state.scale * (prepass ? 2.0f : 1.0f));
 
-	glUniform3fv(colorId, GLsizei(state.colors.size()), &state.colors[0][0]);
+	glUniform3fv(program.uniform("baseColor"), GLsizei(state.colors.size()), &state.colors[0][0]);
 	
 	// Particles trajectories texture.
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, _texParticles);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D_ARRAY, state.tex);
-	GLuint texCountId = glGetUniformLocation(_programParticulesId, "texCount");
-	glUniform1i(texCountId, state.texCount);
+	glUniform1i(program.uniform("texCount"), state.texCount);
+
+	if(_particlesSimulated){
+		// Draw all spawned particles, dead ones are moved off-screen.
+		glBindVertexArray(_vaoSimulationDraw[_simulationCurrent]);
+		glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(_simulationCount));
+		glBindVertexArray(0);
+		glUseProgram(0);
+		glDisable(GL_BLEND);
+		return;
+	}
 
-	// Select the geometry.
-	glBindVertexArray(_vaoParticles);
-	// For each active particles system, draw it with the right parameters.
-	for(const auto & particle : _particles){
-		if(particle.note >= 0){
-			glUniform1i(globalShiftId, particle.note);
-			glUniform1f(timeId, particle.elapsed);
-			glUniform1f(durationId, particle.duration);
-			glUniform1i(channelId, particle.set);
-			glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, state.count);
-		}
+	// Gather the parameters of active particles systems.
+	_systemsData.clear();
+	for(const int pid : _particlesActive){
+		const Particles & particle = _particles[pid];
+		_systemsData.emplace_back(float(particle.note), particle.elapsed, particle.duration, float(particle.set));
+	}
+
+	// Draw all systems at once, each one covering state.count consecutive instances.
+	if(!_systemsData.empty() && state.count > 0){
+		glBindBuffer(GL_ARRAY_BUFFER, _systemsBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, _systemsData.size() * sizeof(glm::vec4), &(_systemsData[0]));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glUniform1i(_programParticles.uniform("systemSize"), state.count);
+		glBindVertexArray(_vaoParticles);
+		glVertexAttribDivisor(1, GLuint(state.count));
+		glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(_systemsData.size()) * state.count);
 	}
 	
 	glBindVertexArray(0);
@@ -314,32 +581,115 @@ void MIDIScene::drawParticles(float time, const glm::vec2 & invScreenSize, const
 
 void MIDIScene::drawNotes(float time, const glm::vec2 & invScreenSize, const ColorArray & majorColors, const ColorArray & minorColors, bool reverseScroll, bool prepass){
 	
-	glUseProgram(_programId);
+	setPassData(invScreenSize, majorColors, minorColors);
+	bindSceneData();
+	_programNotes.use();
 	
 	// Uniforms setup.
-	GLuint screenId = glGetUniformLocation(_programId, "inverseScreenSize");
-	GLuint timeId = glGetUniformLocation(_programId, "time");
-	GLuint colorId = glGetUniformLocation(_programId, "baseColor");
-	GLuint colorMinId = glGetUniformLocation(_programId, "minorColor");
-	GLuint colorScaleId = glGetUniformLocation(_programId, "colorScale");
-	GLuint reverseId = glGetUniformLocation(_programId, "reverseMode");
-	glUniform2fv(screenId,1, &(invScreenSize[0]));
-	glUniform1f(timeId, time);
-	glUniform1f(colorScaleId, prepass ? 0.6f: 1.0f);
-
-	glUniform3fv(colorId, GLsizei(majorColors.size()), &(majorColors[0][0]));
-	glUniform3fv(colorMinId, GLsizei(minorColors.size()), &(minorColors[0][0]));
-	glUniform1i(reverseId, reverseScroll ? 1 : 0);
+	glUniform1f(_programNotes.uniform("time"), time);
+	glUniform1f(_programNotes.uniform("colorScale"), prepass ? 0.6f: 1.0f);
+	glUniform1i(_programNotes.uniform("reverseMode"), reverseScroll ? 1 : 0);
 	
 	// Draw the geometry.
 	glBindVertexArray(_vao);
-	glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(_dataBufferSubsize));
+	if(_notesRanges.empty()){
+		glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(_dataBufferSubsize));
+	} else {
+		updateVisibleRanges(time, reverseScroll);
+		const GLint setOverrideId = _programNotes.uniform("setOverride");
+		int setOverride = -1;
+		glUniform1i(setOverrideId, setOverride);
+		for(const NotesRange & range : _visibleRanges){
+			if(range.set != setOverride){
+				setOverride = range.set;
+				glUniform1i(setOverrideId, setOverride);
+			}
+			// No base instance in GL 3.2, offset the per-note attributes instead.
+			setNotesOffset(range.first);
+			glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(range.count));
+		}
+		setNotesOffset(0);
+	}
 
 	glBindVertexArray(0);
 	glUseProgram(0);
 	
 }
 
+void MIDIScene::updateVisibleRanges(float time, bool reverseScroll){
+	// Notes scroll from the top of the keyboard, either up or down.
+	const float keyboardTop = 2.0f * _sceneData.keyboardHeight - 1.0f;
+	const float speed = (std::max)(_scale, 0.001f);
+	const float windowStart = time - ((reverseScroll ? 1.0f - keyboardTop : 1.0f + keyboardTop) + kVisibleMargin) / speed;
+	const float windowEnd = time + ((reverseScroll ? 1.0f + keyboardTop : 1.0f - keyboardTop) + kVisibleMargin) / speed;
+
+	_visibleRanges.clear();
+	int previousEnd = -1;
+	bool canMerge = false;
+	for(const NotesRange & range : _notesRanges){
+		NotesRange visible = range;
+		if(range.firstBlock >= 0 && range.count > 0){
+			const auto blocksBegin = _notesBlocks.begin() + range.firstBlock;
+			const auto blocksEnd = blocksBegin + blocksCount(range.count);
+			const int firstNote = firstNoteEndingAfter(_notesBlocks.data() + range.firstBlock, range.count, windowStart);
+			// Notes in following blocks all start after the window.
+			const auto last = std::upper_bound(blocksBegin + firstNote / kNotesBlockSize, blocksEnd, windowEnd, [](float end, const NotesBlock & block){
+				return end < block.start;
+			});
+			const int lastNote = (std::min)(int(std::distance(blocksBegin, last)) * kNotesBlockSize, range.count);
+			visible.first = range.first + firstNote;
+			visible.count = lastNote - firstNote;
+		}
+		// Drawing hidden notes of contiguous ranges is cheaper than an additional draw call.
+		// Ranges are only contiguous with the last drawn one if all ranges in between are.
+		canMerge = canMerge && range.first == previousEnd;
+		previousEnd = range.first + range.count;
+		if(visible.count <= 0){
+			continue;
+		}
+		if(canMerge && visible.set == _visibleRanges.back().set && visible.first - (_visibleRanges.back().first + _visibleRanges.back().count) <= kMergeGap){
+			_visibleRanges.back().count = visible.first + visible.count - _visibleRanges.back().first;
+		} else {
+			_visibleRanges.push_back(visible);
+		}
+		canMerge = true;
+	}
+}
+
+size_t MIDIScene::blocksCount(int notesCount){
+	return (size_t((std::max)(notesCount, 0)) + kNotesBlockSize - 1) / kNotesBlockSize;
+}
+
+int MIDIScene::firstNoteEndingAfter(const NotesBlock * blocks, int notesCount, float time){
+	const NotesBlock * blocksEnd = blocks + blocksCount(notesCount);
+	// Notes in previous blocks all end before the time.
+	const NotesBlock * first = std::lower_bound(blocks, blocksEnd, time, [](const NotesBlock & block, float start){
+		return block.end < start;
+	});
+	return (std::min)(int(first - blocks) * kNotesBlockSize, notesCount);
+}
+
+void MIDIScene::computeBlocks(const GPUNote * notes, int notesCount, NotesBlock * blocks){
+	float end = -std::numeric_limits<float>::max();
+	for(int nid = 0; nid < notesCount; ++nid){
+		const GPUNote & note = notes[nid];
+		NotesBlock & block = blocks[nid / kNotesBlockSize];
+		if(nid % kNotesBlockSize == 0){
+			block.start = note.start;
+		}
+		end = (std::max)(end, note.start + note.duration);
+		block.end = end;
+	}
+}
+
+void MIDIScene::setNotesOffset(int first){
+	const size_t offset = size_t(first) * sizeof(GPUNote);
+	glBindBuffer(GL_ARRAY_BUFFER, _dataBuffer);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(offset));
+	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(offset + 4 * sizeof(GLfloat)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void MIDIScene::drawFlashes(float time, const glm::vec2 & invScreenSize, const ColorArray & baseColors, float userScale){
 	
 	// Need alpha blending.
@@ -350,17 +700,14 @@ void MIDIScene::drawFlashes(float time, const glm::vec2 & invScreenSize, const C
 	glBindBuffer(GL_ARRAY_BUFFER, _flagsBufferId);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, _actives.size()*sizeof(int) ,&(_actives[0]));
 	
-	glUseProgram(_programFlashesId);
+	setPassData(invScreenSize);
+	bindSceneData();
+	_programFlashes.use();
 	
 	// Uniforms setup.
-	GLuint screenId1 = glGetUniformLocation(_programFlashesId, "inverseScreenSize");
-	GLuint timeId1 = glGetUniformLocation(_programFlashesId, "time");
-	GLuint colorId = glGetUniformLocation(_programFlashesId, "baseColor");
-	GLuint scaleId = glGetUniformLocation(_programFlashesId, "userScale");
-	glUniform2fv(screenId1,1, &(invScreenSize[0]));
-	glUniform1f(timeId1,time);
-	glUniform3fv(colorId, GLsizei(baseColors.size()), &(baseColors[0][0]));
-	glUniform1f(scaleId,userScale);
+	glUniform1f(_programFlashes.uniform("time"), time);
+	glUniform3fv(_programFlashes.uniform("baseColor"), GLsizei(baseColors.size()), &(baseColors[0][0]));
+	glUniform1f(_programFlashes.uniform("userScale"), userScale);
 	// Flash texture.
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, _texFlash);
@@ -378,21 +725,16 @@ void MIDIScene::drawFlashes(float time, const glm::vec2 & invScreenSize, const C
 
 void MIDIScene::drawKeyboard(float, const glm::vec2 & invScreenSize, const glm::vec3 & keyColor, const ColorArray & majorColors, const ColorArray & minorColors, bool highlightKeys) {
 
-	glUseProgram(_programKeysId);
+	setPassData(invScreenSize);
+	bindSceneData();
+	_programKeys.use();
 
-	// Uniforms setup.
-	const GLuint screenId1 = glGetUniformLocation(_programKeysId, "inverseScreenSize");
-	const GLuint colorId = glGetUniformLocation(_programKeysId, "keysColor");
-	const GLuint majorId = glGetUniformLocation(_programKeysId, "majorColor");
-	const GLuint minorId = glGetUniformLocation(_programKeysId, "minorColor");
-	const GLuint highId = glGetUniformLocation(_programKeysId, "highlightKeys");
-	const GLuint activesId = glGetUniformLocation(_programKeysId, "actives");
-	glUniform2fv(screenId1, 1, &(invScreenSize[0]));
-	glUniform3fv(colorId, 1, &(keyColor[0]));
-	glUniform3fv(majorId, GLsizei(majorColors.size()), &(majorColors[0][0]));
-	glUniform3fv(minorId, GLsizei(minorColors.size()), &(minorColors[0][0]));
-	glUniform1i(highId, int(highlightKeys));
-	glUniform1iv(activesId, GLsizei(_actives.size()), &(_actives[0]));
+	// Uniforms setup, key colors can differ from the notes ones.
+	glUniform3fv(_programKeys.uniform("keysColor"), 1, &(keyColor[0]));
+	glUniform3fv(_programKeys.uniform("majorColor"), GLsizei(majorColors.size()), &(majorColors[0][0]));
+	glUniform3fv(_programKeys.uniform("minorColor"), GLsizei(minorColors.size()), &(minorColors[0][0]));
+	glUniform1i(_programKeys.uniform("highlightKeys"), int(highlightKeys));
+	glUniform1iv(_programKeys.uniform("actives"), GLsizei(_actives.size()), &(_actives[0]));
 
 	// Draw the geometry.
 	glBindVertexArray(_vaoKeyboard);
@@ -405,7 +747,7 @@ void MIDIScene::drawKeyboard(float, const glm::vec2 & invScreenSize, const glm::
 void MIDIScene::drawPedals(float time, const glm::vec2 & invScreenSize, const State::PedalsState & state, float keyboardHeight, bool horizontalMode) {
 
 	glEnable(GL_BLEND);
-	glUseProgram(_programPedalsId);
+	_programPedals.use();
 	glDisable(GL_CULL_FACE);
 
 	// Adjust for aspect ratio.
@@ -437,20 +779,13 @@ void MIDIScene::drawPedals(float time, const glm::vec2 & invScreenSize, const St
 
 
 	// Uniforms setup.
-	const GLuint colorId = glGetUniformLocation(_programPedalsId, "pedalColor");
-	const GLuint opacityId = glGetUniformLocation(_programPedalsId, "pedalOpacity");
-	const GLuint flagsId = glGetUniformLocation(_programPedalsId, "pedalFlags");
-	const GLuint scaleId = glGetUniformLocation(_programPedalsId, "scale");
-	const GLuint mergeId =  glGetUniformLocation(_programPedalsId, "mergePedals");
-	const GLuint shiftId =  glGetUniformLocation(_programPedalsId, "shift");
-
-	glUniform3fv(colorId, 1, &(state.color[0]));
-	glUniform2fv(scaleId, 1, &(scale[0]));
-	glUniform2fv(shiftId, 1, &(shift[0]));
-	glUniform1f(opacityId, state.opacity);
+	glUniform3fv(_programPedals.uniform("pedalColor"), 1, &(state.color[0]));
+	glUniform2fv(_programPedals.uniform("scale"), 1, &(scale[0]));
+	glUniform2fv(_programPedals.uniform("shift"), 1, &(shift[0]));
+	glUniform1f(_programPedals.uniform("pedalOpacity"), state.opacity);
 	// sostenuto, damper, soft
-	glUniform4f(flagsId, _pedals.sostenuto, _pedals.damper, _pedals.soft, _pedals.expression);
-	glUniform1i(mergeId, state.merge ? 1 : 0);
+	glUniform4f(_programPedals.uniform("pedalFlags"), _pedals.sostenuto, _pedals.damper, _pedals.soft, _pedals.expression);
+	glUniform1i(_programPedals.uniform("mergePedals"), state.merge ? 1 : 0);
 
 	// Draw the geometry.
 	glBindVertexArray(_vaoPedals);
@@ -465,22 +800,19 @@ void MIDIScene::drawPedals(float time, const glm::vec2 & invScreenSize, const St
 void MIDIScene::drawWaves(float time, const glm::vec2 & invScreenSize, const State::WaveState & state, float keyboardHeight) {
 
 	glEnable(GL_BLEND);
-	glUseProgram(_programWaveId);
+	bindSceneData();
+	_programWave.use();
 	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
 
 	// Uniforms setup.
-	const GLuint colorId = glGetUniformLocation(_programWaveId, "waveColor");
-	const GLuint opacityId = glGetUniformLocation(_programWaveId, "waveOpacity");
-	const GLuint spreadId = glGetUniformLocation(_programWaveId, "spread");
-	const GLuint scaleId = glGetUniformLocation(_programWaveId, "amplitude");
-	const GLuint freqId =  glGetUniformLocation(_programWaveId, "freq");
-	const GLuint phaseId =  glGetUniformLocation(_programWaveId, "phase");
-	const GLuint shiftId =  glGetUniformLocation(_programWaveId, "keyboardSize");
-
-	glUniform3fv(colorId, 1, &(state.color[0]));
-	glUniform1f(shiftId, keyboardHeight);
-	glUniform1f(opacityId, state.opacity);
-	glUniform1f(spreadId, state.spread);
+	const GLint scaleId = _programWave.uniform("amplitude");
+	const GLint freqId = _programWave.uniform("freq");
+	const GLint phaseId = _programWave.uniform("phase");
+
+	glUniform3fv(_programWave.uniform("waveColor"), 1, &(state.color[0]));
+	glUniform1f(_programWave.uniform("keyboardSize"), keyboardHeight);
+	glUniform1f(_programWave.uniform("waveOpacity"), state.opacity);
+	glUniform1f(_programWave.uniform("spread"), state.spread);
 
 	glBindVertexArray(_vaoWave);
 
@@ -506,44 +838,32 @@ void MIDIScene::drawWaves(float time, const glm::vec2 & invScreenSize, const Sta
 }
 
 void MIDIScene::setMinMaxKeys(int minKey, int minKeyMajor, int notesCount){
-	glUseProgram(_programId);
-	glUniform1i(glGetUniformLocation(_programId, "minNoteMajor"), minKeyMajor);
-	glUniform1f(glGetUniformLocation(_programId, "notesCount"), float(notesCount));
-	glUseProgram(_programFlashesId);
-	glUniform1i(glGetUniformLocation(_programFlashesId, "minNote"), minKey);
-	glUniform1f(glGetUniformLocation(_programFlashesId, "notesCount"), float(notesCount));
-	glUseProgram(_programKeysId);
-	glUniform1i(glGetUniformLocation(_programKeysId, "minNoteMajor"), minKeyMajor);
-	glUniform1f(glGetUniformLocation(_programKeysId, "notesCount"), float(notesCount));
-	glUseProgram(_programParticulesId);
-	glUniform1i(glGetUniformLocation(_programParticulesId, "minNote"), minKey);
-	glUniform1f(glGetUniformLocation(_programParticulesId, "notesCount"), float(notesCount));
-	glUseProgram(0);
+	_sceneData.minNote = minKey;
+	_sceneData.minNoteMajor = minKeyMajor;
+	_sceneData.notesCount = float(notesCount);
+	_sceneDataDirty = true;
 }
 
 
 void MIDIScene::setOrientation(bool horizontal){
-	const int val = horizontal ? 1 : 0;
-	glUseProgram(_programId);
-	glUniform1i(glGetUniformLocation(_programId, "horizontalMode"), val);
-	glUseProgram(_programFlashesId);
-	glUniform1i(glGetUniformLocation(_programFlashesId, "horizontalMode"), val);
-	glUseProgram(_programKeysId);
-	glUniform1i(glGetUniformLocation(_programKeysId, "horizontalMode"), val);
-	glUseProgram(_programParticulesId);
-	glUniform1i(glGetUniformLocation(_programParticulesId, "horizontalMode"), val);
-	glUseProgram(_programWaveId);
-	glUniform1i(glGetUniformLocation(_programWaveId, "horizontalMode"), val);
-	glUseProgram(0);
+	_sceneData.horizontalMode = horizontal ? 1 : 0;
+	_sceneDataDirty = true;
 }
 
 void MIDIScene::clean(){
 	glDeleteVertexArrays(1, &_vao);
 	glDeleteVertexArrays(1, &_vaoFlashes);
 	glDeleteVertexArrays(1, &_vaoParticles);
-	glDeleteProgram(_programId);
-	glDeleteProgram(_programFlashesId);
-	glDeleteProgram(_programParticulesId);
+	_programNotes.clean();
+	_programFlashes.clean();
+	_programParticles.clean();
+	_programParticlesUpdate.clean();
+	_programParticlesSimulated.clean();
+	glDeleteBuffers(1, &_systemsBuffer);
+	glDeleteBuffers(2, &_simulationBuffers[0]);
+	glDeleteVertexArrays(2, &_vaoSimulationUpdate[0]);
+	glDeleteVertexArrays(2, &_vaoSimulationDraw[0]);
+	glDeleteBuffers(1, &_sceneBuffer);
 }
 
 void MIDIScene::upload(const std::vector<GPUNote> & data){
@@ -559,6 +879,18 @@ void MIDIScene::upload(const std::vector<GPUNote> & data, int mini, int maxi){
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+void MIDIScene::upload(const std::vector<GPUNote> & data, int first){
+	glBindBuffer(GL_ARRAY_BUFFER, _dataBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(GPUNote), data.size() * sizeof(GPUNote), &(data[0]));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MIDIScene::allocate(size_t count){
+	glBindBuffer(GL_ARRAY_BUFFER, _dataBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GPUNote) * count, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 MIDISceneEmpty::MIDISceneEmpty(){
 	// Upload one dummy note.
 	std::vector<GPUNote> data = { GPUNote() };
@@ -582,6 +914,10 @@ double MIDISceneEmpty::secondsPerMeasure() const {
 	return 1.0;
 }
 
+std::vector<double> MIDISceneEmpty::measureStarts() const {
+	return {};
+}
+
 int MIDISceneEmpty::notesCount() const {
 	return 0;
 }
@@ -4,8 +4,10 @@
 #include <glm/glm.hpp>
 #include "../midi/MIDIFile.h"
 #include "../State.h"
+#include "../ShaderProgram.h"
 
 #include <fstream>
+#include <deque>
 
 class MIDIScene {
 
@@ -41,6 +43,23 @@ public:
 
 	void resetParticles();
 
+	/// Resize the pool of particles systems and set its behaviour when all systems are active.
+	/// Active systems are discarded if the capacity changes.
+	void setParticlesPool(int capacity, State::ParticlesState::Overflow overflow);
+
+	/// Usage of the pool of particles systems.
+	struct ParticlesCounters {
+		size_t active = 0;
+		size_t capacity = 0;
+		size_t dropped = 0; ///< Notes that didn't get particles because all systems were active.
+		size_t stolen = 0; ///< Systems reused for a new note before the end of their animation.
+	};
+
+	ParticlesCounters particlesCounters() const;
+
+	/// Use particles simulated over time on the GPU instead of particles following precomputed trajectories.
+	void setParticlesSimulation(bool enabled);
+
 	// Type specific methods.
 
 	virtual void updateSets(const SetOptions & options) = 0;
@@ -51,6 +70,9 @@ public:
 
 	virtual double secondsPerMeasure() const = 0;
 
+	/// Start of each measure if they vary with tempo changes, else empty.
+	virtual std::vector<double> measureStarts() const = 0;
+
 	virtual int notesCount() const = 0;
 
 	virtual void print() const = 0;
@@ -84,25 +106,111 @@ protected:
 		float set = 0.0f;
 	};
 
+	/// Part of the notes buffer.
+	struct NotesRange {
+		int first = 0;
+		int count = 0;
+		int firstBlock = -1; ///< If notes in the range are sorted by start, index of their first block in _notesBlocks.
+		int set = -1; ///< If not negative, set used for all notes of the range instead of their own.
+	};
+
+	/// Bounds of consecutive notes sorted by start, to skip the ones outside of the screen.
+	struct NotesBlock {
+		float start = 0.0f; ///< Start of the first note of the block.
+		float end = 0.0f; ///< Latest end of the notes of the range, up to this block included.
+	};
+
+	/// Number of blocks covering a range of notes.
+	static size_t blocksCount(int notesCount);
+
+	/// Compute the blocks of a range of notes sorted by start.
+	static void computeBlocks(const GPUNote * notes, int notesCount, NotesBlock * blocks);
+
+	/// Index of the first note of a range sorted by start that might end after a given time.
+	static int firstNoteEndingAfter(const NotesBlock * blocks, int notesCount, float time);
+
 	void upload(const std::vector<GPUNote> & data);
 	
 	void upload(const std::vector<GPUNote> & data, int mini, int maxi);
 
+	/// Replace notes of the buffer with all the data, starting at a given note.
+	void upload(const std::vector<GPUNote> & data, int first);
+
+	/// Resize the notes buffer, its content is undefined until uploaded.
+	void allocate(size_t count);
+
+	/// Update the animation of active particles systems, releasing the finished ones.
+	void updateParticles(double time, double speed);
+
+	/// Start a particles system for a note, if the pool overflow policy allows it.
+	void emitParticles(int note, int set, float start, float duration);
+
 	std::array<int, 128> _actives;
-	std::vector<Particles> _particles;
+	std::vector<Particles> _particles; ///< Pool of particles systems.
+	std::vector<int> _particlesFree; ///< Indices of inactive systems, used as a stack.
+	std::deque<int> _particlesActive; ///< Indices of active systems, sorted by start so that the oldest is first.
+	State::ParticlesState::Overflow _particlesOverflow = State::ParticlesState::Overflow::STEAL_OLDEST;
+	size_t _particlesDropped = 0;
+	size_t _particlesStolen = 0;
 	Pedals _pedals;
 	int _dataBufferSubsize = 0;
+	float _scale = 1.0f; ///< Vertical speed of notes on screen.
+	/// Ranges of the notes buffer to draw. If empty, the first _dataBufferSubsize notes are drawn.
+	std::vector<NotesRange> _notesRanges;
+	std::vector<NotesBlock> _notesBlocks; ///< For ranges sorted by start.
 	
 private:
 
+	/// Values shared by all programs, with the layout of the SceneData uniform block (std140).
+	struct SceneData {
+		std::array<glm::vec4, SETS_COUNT> majorColors{};
+		std::array<glm::vec4, SETS_COUNT> minorColors{};
+		glm::vec2 inverseScreenSize = glm::vec2(1.0f);
+		float keyboardHeight = 0.25f;
+		float minorsWidth = 1.0f;
+		float notesCount = 0.0f;
+		int minNote = 0;
+		int minNoteMajor = 0;
+		int horizontalMode = 0;
+	};
+
+	/// State of a simulated particle, see particlesupdate.vert.
+	struct SimulatedParticle {
+		glm::vec4 state = glm::vec4(0.0f); ///< Local position and velocity.
+		glm::vec4 infos = glm::vec4(0.0f, 2.0f, 0.0f, 1.0f); ///< Note, age, set and lifetime, dead by default.
+	};
+
+	/// Update the shared values that can change with each pass.
+	void setPassData(const glm::vec2 & invScreenSize);
+
+	void setPassData(const glm::vec2 & invScreenSize, const ColorArray & majorColors, const ColorArray & minorColors);
+
+	/// Upload the shared values if they changed, and bind them for all programs.
+	void bindSceneData();
+
+	void setNotesOffset(int first);
+
+	/// Restrict ranges to draw to the notes that can be visible at a given time.
+	void updateVisibleRanges(float time, bool reverseScroll);
+
+	/// Spawn particles for the notes emitted since the last step, and advance all particles to the current time.
+	void simulateParticles(int particlesPerNote);
+
+
 	void renderSetup();
 
-	GLuint _programId;
-	GLuint _programFlashesId;
-	GLuint _programParticulesId;
-	GLuint _programKeysId;
-	GLuint _programPedalsId;
-	GLuint _programWaveId;
+	ShaderProgram _programNotes;
+	ShaderProgram _programFlashes;
+	ShaderProgram _programParticles;
+	ShaderProgram _programParticlesUpdate;
+	ShaderProgram _programParticlesSimulated;
+	ShaderProgram _programKeys;
+	ShaderProgram _programPedals;
+	ShaderProgram _programWave;
+
+	SceneData _sceneData;
+	GLuint _sceneBuffer;
+	bool _sceneDataDirty = true;
 	
 	GLuint _vao;
 	GLuint _ebo;
@@ -114,6 +222,23 @@ private:
 	
 	GLuint _vaoParticles;
 	GLuint _texParticles;
+	GLuint _systemsBuffer; ///< Note, elapsed time, duration and set of each active particles system.
+	std::vector<glm::vec4> _systemsData;
+
+	std::array<GLuint, 2> _simulationBuffers; ///< Particles states, each one is in turn the source and destination of updates.
+	std::array<GLuint, 2> _vaoSimulationUpdate; ///< Read from the buffer with the same index.
+	std::array<GLuint, 2> _vaoSimulationDraw; ///< Read from the buffer with the same index.
+	std::vector<Particles> _simulationEmitted; ///< Notes to spawn particles for at the next step.
+	std::vector<SimulatedParticle> _simulationSpawns;
+	size_t _simulationCurrent = 0; ///< Buffer with the latest state.
+	size_t _simulationHead = 0; ///< Next particle to replace in the buffers.
+	size_t _simulationCount = 0; ///< Particles spawned since the simulation started, up to the buffers size.
+	double _simulationTime = 0.0;
+	double _particlesTime = 0.0;
+	double _particlesSpeed = 1.0;
+	bool _simulationAllocated = false;
+	bool _simulationReset = true;
+	bool _particlesSimulated = false;
 
 	GLuint _vaoKeyboard;
 
@@ -125,6 +250,8 @@ private:
 	
 	size_t _primitiveCount;
 
+	std::vector<NotesRange> _visibleRanges;
+
 };
 
 class MIDISceneEmpty : public MIDIScene {
@@ -140,6 +267,8 @@ public:
 
 	double secondsPerMeasure() const;
 
+	std::vector<double> measureStarts() const;
+
 	int notesCount() const;
 
 	void print() const;
@@ -4,9 +4,11 @@
 #include <algorithm>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iterator>
+#include <limits>
 
 #include "../../helpers/ProgramUtilities.h"
 #include "../../helpers/ResourcesManager.h"
+#include "../../helpers/System.h"
 
 #include "MIDISceneFile.h"
 
@@ -15,92 +17,539 @@
 #undef MAX
 #endif
 
+// Files with more notes only keep the notes around the current time on the GPU.
+static const size_t kRingMinNotes = size_t(1) << 21;
+// Duration of the chunks of notes sent to the GPU, in seconds.
+static const double kRingChunkDuration = 2.0;
+// Chunks uploaded ahead of the visible ones.
+static const int kRingPrefetchChunks = 1;
+
 MIDISceneFile::~MIDISceneFile(){}
 
-MIDISceneFile::MIDISceneFile(const std::string & midiFilePath, const SetOptions & options) : MIDIScene() {
+MIDISceneFile::MIDISceneFile(const std::string & midiFilePath, const SetOptions & options, NoteOverlap overlap, bool streamed) :
+	MIDISceneFile(load(midiFilePath, options, overlap, streamed, nullptr)) {
+	// Upload all notes at once.
+	continueUpload(_pendingNotes.size());
+}
 
-	_filePath = midiFilePath;
+std::unique_ptr<MIDISceneFile::Content> MIDISceneFile::load(const std::string & midiFilePath, const SetOptions & options, NoteOverlap overlap, bool streamed, LoadingProgress * progress){
+	std::unique_ptr<Content> content(new Content());
+	content->filePath = midiFilePath;
 	// MIDI processing.
-	_midiFile = MIDIFile(_filePath);
+	content->midiFile = MIDIFile(midiFilePath, overlap, streamed, progress);
+	content->midiFile.updateSets(options);
+	if(progress && progress->cancelled){
+		throw "Cancelled";
+	}
+	// Streamed notes are only available once the scene has selected a window.
+	if(!content->midiFile.streamed()){
+		buildNotes(content->midiFile, content->notes, content->ranges, content->blocks);
+	}
+	if(progress){
+		progress->value = 1.0f;
+	}
+	return content;
+}
+
+MIDISceneFile::MIDISceneFile(std::unique_ptr<Content> content) : MIDIScene() {
+	_filePath = content->filePath;
+	_midiFile = std::move(content->midiFile);
 
-	updateSets(options);
+	if(_midiFile.streamed()){
+		// Few notes are in the window, upload them directly.
+		updateWindow(_previousTime, _previousSpeed);
+		uploadNotes();
+	} else if(content->notes.size() >= kRingMinNotes){
+		const size_t tracksCount = _midiFile.tracksCount();
+		_tracksMuted.resize(tracksCount, false);
+		_tracksSoloed.resize(tracksCount, false);
+		_tracksSets.resize(tracksCount, -1);
+		_tracksRanges = std::move(content->ranges);
+		_notesBlocks = std::move(content->blocks);
+		// Keep all notes on the CPU and only upload the chunks around the current time.
+		_ringMode = true;
+		_ringBlocksFirst = _notesBlocks.size();
+		_ringNotes = std::move(content->notes);
+		_chunksCount = chunkIndex(_midiFile.duration()) + 1;
+		_ringCapacity = int(2 * _ringNotes.size() / size_t(_chunksCount));
+		updateNotesRanges();
+		updateRing(_previousTime, _previousSpeed);
+		std::cout << "[INFO]: Streaming notes to the GPU by chunks of " << kRingChunkDuration << " sec." << std::endl;
+	} else {
+		const size_t tracksCount = _midiFile.tracksCount();
+		_tracksMuted.resize(tracksCount, false);
+		_tracksSoloed.resize(tracksCount, false);
+		_tracksSets.resize(tracksCount, -1);
+		_tracksRanges = std::move(content->ranges);
+		_notesBlocks = std::move(content->blocks);
+		_pendingNotes = std::move(content->notes);
+		_uploadedCount = 0;
+		_dataBufferSubsize = int(_pendingNotes.size());
+		// Keep the buffer valid even without notes.
+		if(_pendingNotes.empty()){
+			_pendingNotes.emplace_back();
+		}
+		allocate(_pendingNotes.size());
+		updateNotesRanges();
+	}
 
 	std::cout << "[INFO]: Final track duration " << _midiFile.duration() << " sec." << std::endl;
 }
 
+bool MIDISceneFile::continueUpload(size_t maxNotesCount){
+	if(_uploadedCount >= _pendingNotes.size()){
+		return true;
+	}
+	const size_t count = (std::min)(maxNotesCount, _pendingNotes.size() - _uploadedCount);
+	if(count > 0){
+		upload(_pendingNotes, int(_uploadedCount), int(_uploadedCount + count) - 1);
+		_uploadedCount += count;
+	}
+	if(_uploadedCount < _pendingNotes.size()){
+		return false;
+	}
+	// Everything is on the GPU, release the CPU copy.
+	std::vector<GPUNote>().swap(_pendingNotes);
+	_uploadedCount = 0;
+	return true;
+}
 
 void MIDISceneFile::updateSets(const SetOptions & options){
-	// Generate note data for rendering.
-	_midiFile.updateSets(options);
+	std::vector<std::vector<SetsChange>> changes;
+	_midiFile.updateSets(options, changes);
+	// Streamed notes are reloaded with their new sets, as are notes still being uploaded.
+	if(_midiFile.streamed() || !_pendingNotes.empty()){
+		updateWindow(_previousTime, _previousSpeed);
+		uploadNotes();
+		return;
+	}
+	// Only send notes whose set changed.
+	patchNotes(changes);
+}
 
-	// Load notes shared data.
-	std::vector<GPUNote> data;
-	std::vector<MIDINote> notesM;
-	_midiFile.getNotes(notesM, NoteType::MAJOR, 0);
-	for(auto& note : notesM){
-		data.emplace_back();
-		data.back().note = float(note.note);
-		data.back().start = float(note.start);
-		data.back().duration = float(note.duration);
-		data.back().isMinor = 0.0f;
-		data.back().set = float(note.set);
+void MIDISceneFile::convertNote(const MIDINote & note, bool isMinor, const TempoMap & tempos, TempoMap::Cursor & cursor, GPUNote & result){
+	const double start = tempos.secondsAt(note.startUnits, cursor);
+	TempoMap::Cursor endCursor = cursor;
+	// Keys are numbered separately for major and minor notes.
+	result.note = float((note.note / 12) * 7 + noteShift[note.note % 12]);
+	result.start = float(start);
+	result.duration = float(tempos.secondsAt(note.endUnits, endCursor) - start);
+	result.isMinor = isMinor ? 1.0f : 0.0f;
+	result.set = float(note.set);
+}
+
+void MIDISceneFile::buildNotes(const MIDIFile & midiFile, std::vector<GPUNote> & data, std::vector<TrackRanges> & ranges, std::vector<NotesBlock> & blocks){
+	const size_t tracksCount = midiFile.tracksCount();
+	ranges.assign(tracksCount, TrackRanges());
+
+	// Count notes of each type to place tracks in the buffer.
+	System::forParallel(0, tracksCount, [&midiFile, &ranges](size_t tid){
+		int count = 0;
+		int minorCount = 0;
+		midiFile.forEachNote(tid, [&count, &minorCount](const MIDINote & note){
+			++count;
+			minorCount += noteIsMinor[note.note % 12] ? 1 : 0;
+		});
+		ranges[tid].major.count = count - minorCount;
+		ranges[tid].minor.count = minorCount;
+	});
+	// All major notes are stored before minor notes so that they are drawn first.
+	int first = 0;
+	size_t firstBlock = 0;
+	for(const bool isMinor : { false, true }){
+		for(auto & trackRanges : ranges){
+			NotesRange & range = isMinor ? trackRanges.minor : trackRanges.major;
+			range.first = first;
+			range.firstBlock = int(firstBlock);
+			first += range.count;
+			firstBlock += blocksCount(range.count);
+		}
 	}
+	data.resize(size_t(first));
+	blocks.resize(firstBlock);
 
-	std::vector<MIDINote> notesm;
-	_midiFile.getNotes(notesm, NoteType::MINOR, 0);
-	for(auto& note : notesm){
+	// Each track fills its own ranges in a single pass over its notes.
+	const TempoMap & tempos = midiFile.tempos();
+	System::forParallel(0, tracksCount, [&midiFile, &ranges, &data, &blocks, &tempos](size_t tid){
+		GPUNote * major = data.data() + ranges[tid].major.first;
+		GPUNote * minor = data.data() + ranges[tid].minor.first;
+		// Notes are sorted by start, convert their timings incrementally.
+		TempoMap::Cursor cursor;
+		midiFile.forEachNote(tid, [&major, &minor, &tempos, &cursor](const MIDINote & note){
+			const bool isMinor = noteIsMinor[note.note % 12];
+			convertNote(note, isMinor, tempos, cursor, isMinor ? *(minor++) : *(major++));
+		});
+		// Each range is sorted by start, bound its notes to only draw the visible ones.
+		for(const NotesRange & range : { ranges[tid].major, ranges[tid].minor }){
+			computeBlocks(data.data() + range.first, range.count, blocks.data() + range.firstBlock);
+		}
+	});
+}
+
+void MIDISceneFile::patchNotes(const std::vector<std::vector<SetsChange>> & changes){
+	const TempoMap & tempos = _midiFile.tempos();
+	std::vector<GPUNote> majorData;
+	std::vector<GPUNote> minorData;
+	const size_t tracksCount = (std::min)(changes.size(), _tracksRanges.size());
+	for(size_t tid = 0; tid < tracksCount; ++tid){
+		for(const SetsChange & change : changes[tid]){
+			// A span contains notes of both types, stored in separate parts of the buffer.
+			majorData.clear();
+			minorData.clear();
+			TempoMap::Cursor cursor;
+			bool firstNote = true;
+			_midiFile.forEachNote(tid, change.first, change.last, [&](const MIDINote & note){
+				if(firstNote){
+					cursor = tempos.cursorAt(note.startUnits);
+					firstNote = false;
+				}
+				const bool isMinor = noteIsMinor[note.note % 12];
+				std::vector<GPUNote> & data = isMinor ? minorData : majorData;
+				data.emplace_back();
+				convertNote(note, isMinor, tempos, cursor, data.back());
+			});
+			const int firstMajor = _tracksRanges[tid].major.first + int(change.firstMajor);
+			const int firstMinor = _tracksRanges[tid].minor.first + int(change.firstMinor);
+			if(_ringMode){
+				std::copy(majorData.begin(), majorData.end(), _ringNotes.begin() + firstMajor);
+				std::copy(minorData.begin(), minorData.end(), _ringNotes.begin() + firstMinor);
+				continue;
+			}
+			if(!majorData.empty()){
+				upload(majorData, firstMajor);
+			}
+			if(!minorData.empty()){
+				upload(minorData, firstMinor);
+			}
+		}
+	}
+	// Uploaded chunks are outdated.
+	if(_ringMode){
+		allocateRing();
+		_ringChunks.clear();
+		updateRing(_previousTime, _previousSpeed);
+	}
+}
+
+void MIDISceneFile::uploadNotes(){
+	// Load notes shared data, each track in its own range.
+	std::vector<GPUNote> data;
+	buildNotes(_midiFile, data, _tracksRanges, _notesBlocks);
+	const size_t tracksCount = _midiFile.tracksCount();
+	_tracksMuted.resize(tracksCount, false);
+	_tracksSoloed.resize(tracksCount, false);
+	_tracksSets.resize(tracksCount, -1);
+	// Replaces any partial upload.
+	std::vector<GPUNote>().swap(_pendingNotes);
+	_uploadedCount = 0;
+
+	_dataBufferSubsize = int(data.size());
+	// Keep the buffer valid even without notes.
+	if(data.empty()){
 		data.emplace_back();
-		data.back().note = float(note.note);
-		data.back().start = float(note.start);
-		data.back().duration = float(note.duration);
-		data.back().isMinor =  1.0f;
-		data.back().set = float(note.set);
 	}
 	// Upload to the GPU.
 	upload(data);
-	_dataBufferSubsize = int(data.size());
+	updateNotesRanges();
+}
+
+bool MIDISceneFile::updateWindow(double time, double speed){
+	if(!_midiFile.streamed()){
+		return false;
+	}
+	// Notes are visible on the whole screen height, in both directions to support reverse scrolling.
+	// The blur prepass draws notes at the unscaled time.
+	const double unscaledTime = time / (std::max)(speed, 0.001);
+	const double visibleDuration = 2.0 / (std::max)(double(_scale), 0.001);
+	const double start = (std::min)(time, unscaledTime) - visibleDuration;
+	const double end = (std::max)(time, unscaledTime) + visibleDuration;
+	return _midiFile.setWindow(start, end);
+}
+
+int MIDISceneFile::chunkIndex(double time) const {
+	const int chunk = int((std::max)(time, 0.0) / kRingChunkDuration);
+	return _chunksCount > 0 ? (std::min)(chunk, _chunksCount - 1) : chunk;
+}
+
+bool MIDISceneFile::updateRing(double time, double speed){
+	if(!_ringMode){
+		return false;
+	}
+	// Notes are visible on the whole screen height, in both directions to support reverse scrolling.
+	// The blur prepass draws notes at the unscaled time, only keep the chunks around both times.
+	const double visibleDuration = 2.0 / (std::max)(double(_scale), 0.001);
+	std::vector<int> visible;
+	std::vector<int> needed;
+	for(const double current : { time, time / (std::max)(speed, 0.001) }){
+		const int last = chunkIndex(current + visibleDuration);
+		for(int chunk = chunkIndex(current - visibleDuration); chunk <= last; ++chunk){
+			visible.push_back(chunk);
+		}
+		for(int chunk = chunkIndex(current - visibleDuration); chunk <= (std::min)(last + kRingPrefetchChunks, _chunksCount - 1); ++chunk){
+			needed.push_back(chunk);
+		}
+	}
+	std::sort(visible.begin(), visible.end());
+	visible.erase(std::unique(visible.begin(), visible.end()), visible.end());
+	if(visible == _ringChunks){
+		return false;
+	}
+	std::sort(needed.begin(), needed.end());
+	needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+	// More slots are needed when zooming out, memory only depends on the visible duration.
+	if(needed.size() > _ringSlots.size()){
+		_ringSlots.resize(needed.size());
+		allocateRing();
+	}
+	// Release chunks that are not needed anymore.
+	for(RingSlot & slot : _ringSlots){
+		if(!std::binary_search(needed.begin(), needed.end(), slot.chunk)){
+			slot.chunk = -1;
+		}
+	}
+	for(size_t nid = 0; nid < needed.size(); ++nid){
+		const int chunk = needed[nid];
+		const auto resident = std::find_if(_ringSlots.begin(), _ringSlots.end(), [chunk](const RingSlot & slot){
+			return slot.chunk == chunk;
+		});
+		if(resident != _ringSlots.end()){
+			continue;
+		}
+		const auto freeSlot = std::find_if(_ringSlots.begin(), _ringSlots.end(), [](const RingSlot & slot){
+			return slot.chunk < 0;
+		});
+		buildChunk(chunk, *freeSlot);
+		if(int(_ringStaging.size()) > _ringCapacity){
+			// Grow all slots and upload the chunks again.
+			_ringCapacity = (std::max)(int(_ringStaging.size()), _ringCapacity + _ringCapacity / 2);
+			allocateRing();
+			nid = size_t(-1);
+			continue;
+		}
+		freeSlot->chunk = chunk;
+		if(!_ringStaging.empty()){
+			upload(_ringStaging, int(std::distance(_ringSlots.begin(), freeSlot)) * _ringCapacity);
+		}
+	}
+	_ringChunks = visible;
+	updateNotesRanges();
+	return true;
+}
+
+void MIDISceneFile::allocateRing(){
+	for(RingSlot & slot : _ringSlots){
+		slot.chunk = -1;
+	}
+	_dataBufferSubsize = int(_ringSlots.size()) * _ringCapacity;
+	// Keep the buffer valid even without notes.
+	allocate((std::max)(size_t(_dataBufferSubsize), size_t(1)));
+	_notesBlocks.resize(_ringBlocksFirst + _ringSlots.size() * size_t(slotBlocksCount()));
+}
+
+int MIDISceneFile::slotBlocksCount() const {
+	// Each range can end with a partial block.
+	return int(blocksCount(_ringCapacity) + 4 * _tracksRanges.size());
+}
+
+void MIDISceneFile::buildChunk(int chunk, RingSlot & slot){
+	const float chunkStart = float(double(chunk) * kRingChunkDuration);
+	const float chunkEnd = chunk + 1 < _chunksCount ? float(double(chunk + 1) * kRingChunkDuration) : std::numeric_limits<float>::max();
+	const size_t tracksCount = _tracksRanges.size();
+	slot.major.resize(tracksCount);
+	slot.minor.resize(tracksCount);
+	_ringStaging.clear();
+	// All major notes are stored before minor notes so that they are drawn first.
+	for(const bool isMinor : { false, true }){
+		std::vector<SlotRange> & slotRanges = isMinor ? slot.minor : slot.major;
+		// Carried notes of all tracks are stored together, to draw the notes of following chunks at once.
+		for(size_t tid = 0; tid < tracksCount; ++tid){
+			const NotesRange & range = isMinor ? _tracksRanges[tid].minor : _tracksRanges[tid].major;
+			const GPUNote * notes = _ringNotes.data() + range.first;
+			SlotRange & slotRange = slotRanges[tid];
+			const GPUNote * begin = std::lower_bound(notes, notes + range.count, chunkStart, [](const GPUNote & note, float start){
+				return note.start < start;
+			});
+			const GPUNote * end = std::lower_bound(begin, notes + range.count, chunkEnd, [](const GPUNote & note, float start){
+				return note.start < start;
+			});
+			slotRange.first = int(std::distance(notes, begin));
+			slotRange.count = int(std::distance(begin, end));
+			slotRange.carriedFirst = int(_ringStaging.size());
+			slotRange.carriedStarts.clear();
+			if(range.count > 0){
+				for(const GPUNote * note = notes + firstNoteEndingAfter(_notesBlocks.data() + range.firstBlock, range.count, chunkStart); note < begin; ++note){
+					if(note->start + note->duration > chunkStart){
+						_ringStaging.push_back(*note);
+						slotRange.carriedStarts.push_back(note->start);
+					}
+				}
+			}
+			slotRange.carriedCount = int(_ringStaging.size()) - slotRange.carriedFirst;
+		}
+		for(size_t tid = 0; tid < tracksCount; ++tid){
+			const NotesRange & range = isMinor ? _tracksRanges[tid].minor : _tracksRanges[tid].major;
+			SlotRange & slotRange = slotRanges[tid];
+			const auto notes = _ringNotes.begin() + range.first + slotRange.first;
+			slotRange.first = int(_ringStaging.size());
+			_ringStaging.insert(_ringStaging.end(), notes, notes + slotRange.count);
+		}
+	}
+	if(int(_ringStaging.size()) > _ringCapacity){
+		return;
+	}
+	// Each range is sorted by start, bound its notes to only draw the visible ones.
+	size_t firstBlock = _ringBlocksFirst + size_t(std::distance(_ringSlots.data(), &slot)) * size_t(slotBlocksCount());
+	for(std::vector<SlotRange> * slotRanges : { &slot.major, &slot.minor }){
+		for(SlotRange & slotRange : *slotRanges){
+			slotRange.carriedFirstBlock = int(firstBlock);
+			computeBlocks(_ringStaging.data() + slotRange.carriedFirst, slotRange.carriedCount, _notesBlocks.data() + firstBlock);
+			firstBlock += blocksCount(slotRange.carriedCount);
+			slotRange.firstBlock = int(firstBlock);
+			computeBlocks(_ringStaging.data() + slotRange.first, slotRange.count, _notesBlocks.data() + firstBlock);
+			firstBlock += blocksCount(slotRange.count);
+		}
+	}
+}
+
+void MIDISceneFile::updateNotesRanges(){
+	const size_t tracksCount = _tracksRanges.size();
+	bool anySoloed = false;
+	for(size_t tid = 0; tid < tracksCount; ++tid){
+		anySoloed = anySoloed || _tracksSoloed[tid];
+	}
+	_tracksEnabled.resize(tracksCount);
+	for(size_t tid = 0; tid < tracksCount; ++tid){
+		_tracksEnabled[tid] = !_tracksMuted[tid] && (!anySoloed || _tracksSoloed[tid]);
+	}
+
+	// Ranges stay separate to only draw visible notes of each track, they are merged when drawing.
+	_notesRanges.clear();
+	for(const bool isMinor : { false, true }){
+		if(_ringMode){
+			// Draw the chunks in order. A note started before the end of the previous drawn chunk is already drawn,
+			// either with its own chunk or carried into the first chunk of a previous run of consecutive chunks.
+			float drawnEnd = -std::numeric_limits<float>::max();
+			for(size_t cid = 0; cid < _ringChunks.size(); ++cid){
+				const int chunk = _ringChunks[cid];
+				const auto slot = std::find_if(_ringSlots.begin(), _ringSlots.end(), [chunk](const RingSlot & ringSlot){
+					return ringSlot.chunk == chunk;
+				});
+				if(slot == _ringSlots.end()){
+					continue;
+				}
+				const int slotFirst = int(std::distance(_ringSlots.begin(), slot)) * _ringCapacity;
+				const std::vector<SlotRange> & slotRanges = isMinor ? slot->minor : slot->major;
+				for(const bool carried : { true, false }){
+					for(size_t tid = 0; tid < tracksCount; ++tid){
+						if(!_tracksEnabled[tid]){
+							continue;
+						}
+						const SlotRange & slotRange = slotRanges[tid];
+						NotesRange range;
+						range.set = _tracksSets[tid];
+						if(!carried){
+							range.first = slotFirst + slotRange.first;
+							range.count = slotRange.count;
+							range.firstBlock = slotRange.firstBlock;
+							_notesRanges.push_back(range);
+							continue;
+						}
+						const int drawn = int(std::distance(slotRange.carriedStarts.begin(), std::lower_bound(slotRange.carriedStarts.begin(), slotRange.carriedStarts.end(), drawnEnd)));
+						if(drawn == slotRange.carriedCount){
+							continue;
+						}
+						range.first = slotFirst + slotRange.carriedFirst + drawn;
+						range.count = slotRange.carriedCount - drawn;
+						// Blocks only match the full range.
+						range.firstBlock = drawn == 0 ? slotRange.carriedFirstBlock : -1;
+						_notesRanges.push_back(range);
+					}
+				}
+				drawnEnd = chunk + 1 < _chunksCount ? float(double(chunk + 1) * kRingChunkDuration) : std::numeric_limits<float>::max();
+			}
+			continue;
+		}
+		for(size_t tid = 0; tid < tracksCount; ++tid){
+			if(_tracksEnabled[tid]){
+				_notesRanges.push_back(isMinor ? _tracksRanges[tid].minor : _tracksRanges[tid].major);
+				_notesRanges.back().set = _tracksSets[tid];
+			}
+		}
+	}
+	// Nothing to draw.
+	if(_notesRanges.empty()){
+		_notesRanges.push_back(NotesRange());
+	}
+}
+
+const MIDIStatistics & MIDISceneFile::statistics() const {
+	return _midiFile.statistics();
+}
+
+size_t MIDISceneFile::tracksCount() const {
+	return _midiFile.tracksCount();
+}
+
+const std::string& MIDISceneFile::trackName(size_t track) const {
+	return _midiFile.trackName(track);
+}
+
+bool MIDISceneFile::trackMuted(size_t track) const {
+	return _tracksMuted[track];
+}
+
+bool MIDISceneFile::trackSoloed(size_t track) const {
+	return _tracksSoloed[track];
+}
+
+void MIDISceneFile::setTrackMuted(size_t track, bool muted){
+	_tracksMuted[track] = muted;
+	updateNotesRanges();
+}
+
+void MIDISceneFile::setTrackSoloed(size_t track, bool soloed){
+	_tracksSoloed[track] = soloed;
+	updateNotesRanges();
+}
+
+int MIDISceneFile::trackSet(size_t track) const {
+	return _tracksSets[track];
+}
+
+void MIDISceneFile::setTrackSet(size_t track, int set){
+	_tracksSets[track] = set;
+	updateNotesRanges();
 }
 
 void MIDISceneFile::updatesActiveNotes(double time, double speed){
 	// Update the particle systems lifetimes.
-	for(auto & particle : _particles){
-		// Give a bit of a head start to the animation.
-		particle.elapsed = (float(time) - particle.start + 0.25f) / (float(speed) * particle.duration);
-		// Disable particles that shouldn't be visible at the current time.
-		if(float(time) >= particle.start + particle.duration || float(time) < particle.start){
-			particle.note = -1;
-			particle.set = -1;
-			particle.duration = particle.start = particle.elapsed = 0.0f;
-		}
+	updateParticles(time, speed);
+	// Reload notes if the visible range of a streamed file changed.
+	if(updateWindow(time, speed)){
+		uploadNotes();
 	}
+	updateRing(time, speed);
+
 	// Get notes actives.
 	auto actives = ActiveNotesArray();
-	_midiFile.getNotesActive(actives, time, 0);
+	_midiFile.getNotesActive(actives, time, _tracksEnabled, _tracksSets);
 	for(int i = 0; i < 128; ++i){
 		const auto & note = actives[i];
 		_actives[i] = note.enabled ? note.set : -1;
 		// Check if the note was triggered at this frame.
 		if(note.start > _previousTime && note.start <= time){
-			// Find an available particles system and update it with the note parameters.
-			for(auto & particle : _particles){
-				if(particle.note < 0){
-					// Update with new note parameter.
-					//const float durationTweak = 3.0f - note.velocity / 127.0f * 2.5f;
-					particle.duration = (std::max)(note.duration*2.0f, note.duration + 1.2f);
-					particle.start = note.start;
-					particle.note = i;
-					particle.set = note.set;
-					particle.elapsed = 0.0f;
-					break;
-				}
-			}
+			// Start a particles system with the note parameters.
+			//const float durationTweak = 3.0f - note.velocity / 127.0f * 2.5f;
+			emitParticles(i, note.set, note.start, (std::max)(note.duration*2.0f, note.duration + 1.2f));
 		}
 	}
 	_previousTime = time;
+	_previousSpeed = speed;
 
 	// Update pedal state.
 	_pedals.damper = _pedals.sostenuto = _pedals.soft = _pedals.expression = 0.0f;
-	_midiFile.getPedalsActive(_pedals.damper, _pedals.sostenuto, _pedals.soft, _pedals.expression, time, 0);
+	_midiFile.getPedalsActive(_pedals.damper, _pedals.sostenuto, _pedals.soft, _pedals.expression, time);
 }
 
 double MIDISceneFile::duration() const {
@@ -111,6 +560,10 @@ double MIDISceneFile::secondsPerMeasure() const {
 	return _midiFile.secondsPerMeasure();
 }
 
+std::vector<double> MIDISceneFile::measureStarts() const {
+	return _midiFile.measureStarts();
+}
+
 int MIDISceneFile::notesCount() const {
 	return _midiFile.notesCount();
 }
@@ -10,7 +10,32 @@ class MIDISceneFile : public MIDIScene {
 
 public:
 
-	MIDISceneFile(const std::string & midiFilePath, const SetOptions & options);
+	/// Parts of the notes buffer used by a track.
+	struct TrackRanges {
+		NotesRange major;
+		NotesRange minor;
+	};
+
+	/// Parsed file and notes ready to upload, see load.
+	struct Content {
+		MIDIFile midiFile;
+		std::string filePath;
+		std::vector<GPUNote> notes;
+		std::vector<TrackRanges> ranges;
+		std::vector<NotesBlock> blocks;
+	};
+
+	MIDISceneFile(const std::string & midiFilePath, const SetOptions & options, NoteOverlap overlap, bool streamed);
+
+	/// Parse a file and prepare its notes for rendering, without any GPU work so that it can run on another thread.
+	static std::unique_ptr<Content> load(const std::string & midiFilePath, const SetOptions & options, NoteOverlap overlap, bool streamed, LoadingProgress * progress);
+
+	/// Create a scene from loaded content. Notes are sent to the GPU by calls to continueUpload.
+	MIDISceneFile(std::unique_ptr<Content> content);
+
+	/// Upload the next notes of loaded content to the GPU.
+	/// \return true once all notes are uploaded
+	bool continueUpload(size_t maxNotesCount);
 
 	void updateSets(const SetOptions & options);
 
@@ -22,6 +47,8 @@ public:
 
 	double secondsPerMeasure() const;
 
+	std::vector<double> measureStarts() const;
+
 	int notesCount() const;
 
 	void print() const;
@@ -30,11 +57,100 @@ public:
 
 	const std::string& filePath() const;
 
+	const MIDIStatistics & statistics() const;
+
+	size_t tracksCount() const;
+
+	const std::string& trackName(size_t track) const;
+
+	bool trackMuted(size_t track) const;
+
+	bool trackSoloed(size_t track) const;
+
+	void setTrackMuted(size_t track, bool muted);
+
+	void setTrackSoloed(size_t track, bool soloed);
+
+	/// Set used for all notes of a track, or -1 to use the set of each note.
+	int trackSet(size_t track) const;
+
+	void setTrackSet(size_t track, int set);
+
 private:
 
+	/// Generate rendering data for the notes of a file, each track in its own range.
+	static void buildNotes(const MIDIFile & midiFile, std::vector<GPUNote> & data, std::vector<TrackRanges> & ranges, std::vector<NotesBlock> & blocks);
+
+	/// Generate rendering data for a note. Converting notes sorted by start with the same cursor is faster.
+	static void convertNote(const MIDINote & note, bool isMinor, const TempoMap & tempos, TempoMap::Cursor & cursor, GPUNote & result);
+
+	/// Update the notes whose set changed in the GPU buffer.
+	void patchNotes(const std::vector<std::vector<SetsChange>> & changes);
+
+	/// Upload notes to the GPU, each track in its own range.
+	void uploadNotes();
+
+	/// Select the parts of the notes buffer to draw based on muted and soloed tracks.
+	void updateNotesRanges();
+
+	/// For streamed files, keep the notes visible around a given time available.
+	/// \return true if notes changed
+	bool updateWindow(double time, double speed);
+
+	/// Notes of a track for one type in a ring slot.
+	struct SlotRange {
+		int carriedFirst = 0; ///< Notes started in previous chunks, only drawn if not already drawn with their own chunk.
+		int carriedCount = 0;
+		int carriedFirstBlock = -1;
+		std::vector<float> carriedStarts; ///< Start of each carried note, sorted.
+		int first = 0; ///< Notes started in the chunk.
+		int count = 0;
+		int firstBlock = -1;
+	};
+
+	/// Part of the notes buffer holding the notes of a time chunk.
+	struct RingSlot {
+		int chunk = -1;
+		std::vector<SlotRange> major; ///< Per track.
+		std::vector<SlotRange> minor; ///< Per track.
+	};
+
+	/// For large files, upload the chunks of notes visible around a given time to the ring of slots.
+	/// \return true if chunks changed
+	bool updateRing(double time, double speed);
+
+	/// Gather the notes of a chunk in the staging data, all carried notes before the ones started in the chunk.
+	/// If they fit in a slot, the blocks of its ranges are computed in the slot region of _notesBlocks.
+	void buildChunk(int chunk, RingSlot & slot);
+
+	/// Resize the notes buffer and the blocks to hold all slots, releasing their chunks.
+	void allocateRing();
+
+	/// Blocks reserved for the ranges of a slot.
+	int slotBlocksCount() const;
+
+	int chunkIndex(double time) const;
+
 	MIDIFile _midiFile;
 	std::string _filePath;
+	std::vector<TrackRanges> _tracksRanges;
+	std::vector<bool> _tracksMuted;
+	std::vector<bool> _tracksSoloed;
+	std::vector<int> _tracksSets; ///< Set overriding the set of the notes of each track, if not negative.
+	std::vector<bool> _tracksEnabled;
 	double _previousTime = 0.0;
+	double _previousSpeed = 1.0;
+	std::vector<GPUNote> _pendingNotes; ///< Loaded notes not fully uploaded yet.
+	size_t _uploadedCount = 0;
+	// Large files only keep chunks of notes around the current time on the GPU.
+	bool _ringMode = false;
+	std::vector<GPUNote> _ringNotes; ///< All notes, each track in its own range.
+	std::vector<GPUNote> _ringStaging;
+	std::vector<RingSlot> _ringSlots;
+	int _ringCapacity = 0; ///< Notes per slot.
+	std::vector<int> _ringChunks; ///< Visible chunks, sorted.
+	size_t _ringBlocksFirst = 0; ///< Blocks of the slots are stored after the ones of all notes.
+	int _chunksCount = 0;
 	
 };
 
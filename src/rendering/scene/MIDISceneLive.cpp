@@ -46,7 +46,6 @@ MIDISceneLive::MIDISceneLive(int port, bool verbose) : MIDIScene() {
 	_notesInfos.resize(MAX_NOTES_IN_FLIGHT);
 	_allMessages.reserve(MAX_NOTES_IN_FLIGHT);
 	_secondsPerMeasure = computeMeasureDuration(_tempo, _signatureNum / _signatureDenom);
-	_pedalInfos[-10000.0f] = Pedals();
 	upload(_notes);
 
 }
@@ -80,16 +79,7 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed){
 	}
 
 	// Update the particle systems lifetimes.
-	for(auto & particle : _particles){
-		// Give a bit of a head start to the animation.
-		particle.elapsed = (float(time) - particle.start + 0.25f) / (float(speed) * particle.duration);
-		// Disable particles that shouldn't be visible at the current time.
-		if(float(time) >= particle.start + particle.duration || float(time) < particle.start){
-			particle.note = -1;
-			particle.set = -1;
-			particle.duration = particle.start = particle.elapsed = 0.0f;
-		}
-	}
+	updateParticles(time, speed);
 
 	// Restore all active flags.
 	for(size_t nid = 0; nid < _actives.size(); ++nid){
@@ -111,11 +101,11 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed){
 	}
 
 	// Restore pedals to the last known state.
-	_pedals = Pedals();
-	auto nextBig = _pedalInfos.upper_bound(float(time));
-	if(nextBig != _pedalInfos.begin()){
-		_pedals = std::prev(nextBig)->second;
-	}
+	const float pedalTime = float(time);
+	_pedals.damper = _pedalTimelines[0].valueAt(pedalTime, _pedalCursors[0]);
+	_pedals.sostenuto = _pedalTimelines[1].valueAt(pedalTime, _pedalCursors[1]);
+	_pedals.soft = _pedalTimelines[2].valueAt(pedalTime, _pedalCursors[2]);
+	_pedals.expression = _pedalTimelines[3].valueAt(pedalTime, _pedalCursors[3]);
 
 	// Process new events.
 	MIDIFrame frame;
@@ -180,19 +170,10 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed){
 				minUpdated = (std::min)(minUpdated, int(index));
 				maxUpdated = (std::max)(maxUpdated, int(index));
 
-				// Find an available particles system and update it with the note parameters.
-				for(auto & particle : _particles){
-					if(particle.note < 0){
-						// Update with new note parameter.
-						//const float durationTweak = 3.0f - float(velocity) / 127.0f * 2.5f;
-						particle.duration = 10.0f; // Fixed value.
-						particle.start = newNote.start;
-						particle.note = note;
-						particle.set = int(newNote.set);
-						particle.elapsed = 0.0f;
-						break;
-					}
-				}
+				// Start a particles system with the note parameters.
+				//const float durationTweak = 3.0f - float(velocity) / 127.0f * 2.5f;
+				// Fixed duration.
+				emitParticles(note, int(newNote.set), newNote.start, 10.0f);
 
 				++_notesCount;
 			}
@@ -237,6 +218,7 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed){
 			}
 			const PedalType type = PedalType(rawType);
 
+			const int pedalId = (type == DAMPER ? 0 : (type == SOSTENUTO ? 1 : (type == SOFT ? 2 : 3)));
 			float & pedal = (type == DAMPER ? _pedals.damper : (type == SOSTENUTO ? _pedals.sostenuto : (type == SOFT ? _pedals.soft : _pedals.expression)));
 			// Stop the current pedal.
 			pedal = 0.0f;
@@ -245,8 +227,8 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed){
 			if(val > 0){
 				pedal = float(val)/127.0f;
 			}
-			// Register new pedal event with updated state.
-			_pedalInfos[float(time)] = Pedals(_pedals);
+			// Register new pedal event in the history.
+			_pedalTimelines[pedalId].setValue(float(time), pedal);
 		} else {
 			if(_verbose){
 				std::cout << "Other (" << message.timestamp << ")\n";
@@ -279,18 +261,8 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed){
 		}
 		// Detect notes that started at this frame.
 		if(note.start > _previousTime && note.start <= time){
-			// Find an available particles system and update it with the note parameters.
-			for(auto & particle : _particles){
-				if(particle.note < 0){
-					// Update with new note parameter.
-					particle.duration = (std::max)(note.duration*2.0f, note.duration + 1.2f);
-					particle.start = note.start;
-					particle.note = noteId.note;
-					particle.set = int(note.set);
-					particle.elapsed = 0.0f;
-					break;
-				}
-			}
+			// Start a particles system with the note parameters.
+			emitParticles(noteId.note, int(note.set), note.start, (std::max)(note.duration*2.0f, note.duration + 1.2f));
 		}
 	}
 
@@ -313,6 +285,11 @@ double MIDISceneLive::secondsPerMeasure() const {
 	return _secondsPerMeasure;
 }
 
+std::vector<double> MIDISceneLive::measureStarts() const {
+	// Tempo changes are not known in advance.
+	return {};
+}
+
 int MIDISceneLive::notesCount() const {
 	return _notesCount;
 }
@@ -3,11 +3,11 @@
 #include <gl3w/gl3w.h>
 #include <glm/glm.hpp>
 #include "../midi/MIDIBase.h"
+#include "../midi/PedalTimeline.h"
 #include "../State.h"
 #include "MIDIScene.h"
 
 #include <libremidi/libremidi.hpp>
-#include <map>
 
 #define VIRTUAL_DEVICE_NAME "VIRTUAL"
 
@@ -27,6 +27,8 @@ public:
 
 	double secondsPerMeasure() const;
 
+	std::vector<double> measureStarts() const;
+
 	int notesCount() const;
 
 	void print() const;
@@ -53,7 +55,8 @@ private:
 	std::vector<NoteInfos> _notesInfos;
 	std::array<int, 128> _activeIds;
 	std::array<bool, 128> _activeRecording;
-	std::map<float, Pedals> _pedalInfos;
+	std::array<PedalTimeline, 4> _pedalTimelines; ///< History of damper, sostenuto, soft and expression values.
+	std::array<PedalTimeline::Cursor, 4> _pedalCursors;
 	std::vector<MIDIFrame> _allMessages;
 
 	double _previousTime = 0.0;